@@ -94,6 +94,20 @@ inline void throw_std_bad_alloc()
   #endif
 }
 
+/*****************************************************************************
+*** User-provided allocation functions                                     ***
+*****************************************************************************/
+
+#ifdef EIGEN_USER_ALIGNED_MALLOC
+/** \internal If EIGEN_USER_ALIGNED_MALLOC is defined, all heap memory is obtained from these
+  * functions, which have to be defined by the application. Returned pointers have to be
+  * 16-byte aligned, and reallocated memory has to keep its content.
+  */
+void* user_aligned_malloc(size_t size);
+void  user_aligned_free(void *ptr);
+void* user_aligned_realloc(void *ptr, size_t new_size);
+#endif
+
 /*****************************************************************************
 *** Implementation of handmade aligned functions                           ***
 *****************************************************************************/
@@ -211,7 +225,9 @@ inline void* aligned_malloc(size_t size)
   check_that_malloc_is_allowed();
 
   void *result;
-  #if !EIGEN_ALIGN
+  #if defined EIGEN_USER_ALIGNED_MALLOC
+    result = user_aligned_malloc(size);
+  #elif !EIGEN_ALIGN
     result = std::malloc(size);
   #elif EIGEN_MALLOC_ALREADY_ALIGNED
     result = std::malloc(size);
@@ -234,7 +250,9 @@ inline void* aligned_malloc(size_t size)
 /** \internal Frees memory allocated with aligned_malloc. */
 inline void aligned_free(void *ptr)
 {
-  #if !EIGEN_ALIGN
+  #if defined EIGEN_USER_ALIGNED_MALLOC
+    user_aligned_free(ptr);
+  #elif !EIGEN_ALIGN
     std::free(ptr);
   #elif EIGEN_MALLOC_ALREADY_ALIGNED
     std::free(ptr);
@@ -259,7 +277,9 @@ inline void* aligned_realloc(void *ptr, size_t new_size, size_t old_size)
   EIGEN_UNUSED_VARIABLE(old_size);
 
   void *result;
-#if !EIGEN_ALIGN
+#if defined EIGEN_USER_ALIGNED_MALLOC
+  result = user_aligned_realloc(ptr,new_size);
+#elif !EIGEN_ALIGN
   result = std::realloc(ptr,new_size);
 #elif EIGEN_MALLOC_ALREADY_ALIGNED
   result = std::realloc(ptr,new_size);
@@ -302,7 +322,11 @@ template<> inline void* conditional_aligned_malloc<false>(size_t size)
 {
   check_that_malloc_is_allowed();
 
-  void *result = std::malloc(size);
+  #if defined EIGEN_USER_ALIGNED_MALLOC
+    void *result = user_aligned_malloc(size);
+  #else
+    void *result = std::malloc(size);
+  #endif
   if(!result && size)
     throw_std_bad_alloc();
   return result;
@@ -316,7 +340,11 @@ template<bool Align> inline void conditional_aligned_free(void *ptr)
 
 template<> inline void conditional_aligned_free<false>(void *ptr)
 {
-  std::free(ptr);
+  #if defined EIGEN_USER_ALIGNED_MALLOC
+    user_aligned_free(ptr);
+  #else
+    std::free(ptr);
+  #endif
 }
 
 template<bool Align> inline void* conditional_aligned_realloc(void* ptr, size_t new_size, size_t old_size)
@@ -326,7 +354,11 @@ template<bool Align> inline void* conditional_aligned_realloc(void* ptr, size_t
 
 template<> inline void* conditional_aligned_realloc<false>(void* ptr, size_t new_size, size_t)
 {
-  return std::realloc(ptr, new_size);
+  #if defined EIGEN_USER_ALIGNED_MALLOC
+    return user_aligned_realloc(ptr, new_size);
+  #else
+    return std::realloc(ptr, new_size);
+  #endif
 }
 
 /*****************************************************************************
@@ -0,0 +1,141 @@
+#ifndef BATCHLLT_H
+#define BATCHLLT_H
+
+#include "Eigen/Core"
+#include "types.h"
+#include "Eigen/Cholesky"
+#include <vector>
+#include <list>
+#include <map>
+
+using namespace Eigen;
+using std::vector;
+using std::list;
+using std::multimap;
+
+// dimensionalities for which kernels with compile-time sizes are generated; each entry has
+// to be wrapped in BATCHLLT_DIM, other dimensionalities use kernels with runtime sizes
+#ifndef BATCHLLT_FIXED_DIMS
+#define BATCHLLT_FIXED_DIMS BATCHLLT_DIM(16) BATCHLLT_DIM(64) BATCHLLT_DIM(144) BATCHLLT_DIM(256)
+#endif
+
+// solves many systems of the form A diag(v_j) A^T x_j = r_j at once; factors of
+// neighboring systems are stored interleaved so that the work vectorizes across them;
+// optionally, systems with identical variances share a single factorization, which is
+// kept in a cache of the given size
+class BatchLLT {
+	public:
+		BatchLLT(const MatrixXr& basis, int cacheSize = 0);
+
+		inline int dim() const;
+
+		inline long numHits() const;
+		inline long numMisses() const;
+		inline double hitRate() const;
+
+		void solve(const MatrixXr& variances, const MatrixXr& inputs, MatrixXr& outputs);
+		void sample(
+			const MatrixXr& variances,
+			const MatrixXr& inputs,
+			const MatrixXr& noise,
+			MatrixXr& outputs);
+
+	protected:
+		// maximal number of precomputed products between pairs of basis rows
+		static const int kMaxPairProducts = 1 << 16;
+
+		// approximate size of a tile's factors in number of scalars
+		static const int kTileSize = 1 << 15;
+
+		// number of lanes used for a given dimensionality, computed as in the constructor
+		template <int Dim>
+		struct Lanes {
+			enum {
+				numPairs = Dim * (Dim + 1) / 2,
+				tileLanes = kTileSize / numPairs / 4 * 4,
+				value = tileLanes < 4 ? 4 : (tileLanes > 64 ? 64 : tileLanes)
+			};
+		};
+
+		typedef void (BatchLLT::*FactorKernel)(const MatrixXr&, int, int, real_t*, real_t*, real_t*);
+		typedef void (BatchLLT::*SubstituteKernel)(const real_t*, const real_t*, const real_t*, real_t*);
+
+		struct CacheEntry {
+			size_t hash;
+			VectorXr variances;
+			LLT<MatrixXr> factor;
+		};
+
+		typedef list<CacheEntry> Cache;
+
+		int mDim;
+		int mNumPairs;
+		int mNumLanes;
+		FactorKernel mFactor;
+		SubstituteKernel mSubstitute;
+		MatrixXr mBasis;
+		MatrixXr mPairProducts;
+		vector<VectorXr> mWorkspaces;
+
+		// factors ordered from most to least recently used
+		int mCacheSize;
+		Cache mCache;
+		multimap<size_t, Cache::iterator> mCacheIndex;
+		long mNumHits;
+		long mNumMisses;
+
+		void solve(
+			const MatrixXr& variances,
+			const MatrixXr& inputs,
+			const MatrixXr* noise,
+			MatrixXr& outputs);
+		void solveCached(
+			const MatrixXr& variances,
+			const MatrixXr& inputs,
+			const MatrixXr* noise,
+			MatrixXr& outputs);
+		Cache::iterator lookup(const MatrixXr& variances, int col, size_t hash);
+
+		// kernels for dimensionalities and lane counts known at compile time, or Dynamic
+		template <int Dim, int NumLanes>
+		void factor(
+			const MatrixXr& variances,
+			int offset,
+			int numCols,
+			real_t* factors,
+			real_t* invDiag,
+			real_t* vars);
+		template <int Dim, int NumLanes>
+		void substitute(
+			const real_t* factors,
+			const real_t* invDiag,
+			const real_t* noise,
+			real_t* vectors);
+};
+
+
+
+inline int BatchLLT::dim() const {
+	return mDim;
+}
+
+
+
+inline long BatchLLT::numHits() const {
+	return mNumHits;
+}
+
+
+
+inline long BatchLLT::numMisses() const {
+	return mNumMisses;
+}
+
+
+
+inline double BatchLLT::hitRate() const {
+	return mNumHits + mNumMisses > 0 ?
+		static_cast<double>(mNumHits) / (mNumHits + mNumMisses) : 0.;
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef CHAINSTORE_H
+#define CHAINSTORE_H
+
+#include "Eigen/Core"
+#include "types.h"
+#include <string>
+
+using namespace Eigen;
+using std::string;
+
+// holds the states of persistent Markov chains, one chain per column; the states are
+// either kept in memory or in a memory-mapped file, in which case they can be larger
+// than the available memory as long as they are accessed in blocks of columns
+class ChainStore {
+	public:
+		ChainStore();
+
+		// copies of mapped stores keep their states in memory
+		ChainStore(const ChainStore& store);
+		virtual ~ChainStore();
+
+		ChainStore& operator=(const ChainStore& store);
+		ChainStore& operator=(const MatrixXr& states);
+
+		// takes over the memory of the states unless the store is mapped to a file
+		ChainStore& operator=(MatrixXr&& states);
+
+		inline int rows() const;
+		inline int cols() const;
+
+		inline bool mapped() const;
+		inline string filename() const;
+
+		void resize(int rows, int cols);
+
+		// moves the states into a file, which is created or overwritten unless it is mapped by
+		// another store
+		void map(const string& filename);
+
+		// uses the states stored in an existing file; a file can only be mapped by one store
+		// of a process at a time
+		void open(const string& filename, int rows);
+
+		// copies the states stored in a file into memory without mapping the file
+		void load(const string& filename, int rows);
+
+		// whether any store of this process has mapped the file
+		static bool inUse(const string& filename);
+
+		// copies the states back into memory and closes the file
+		void unmap();
+
+		Map<MatrixXr> matrix();
+		Map<const MatrixXr> matrix() const;
+		Map<MatrixXr> block(int offset, int numCols);
+
+		// asks the operating system to start reading a block of states from disk
+		void prefetch(int offset, int numCols) const;
+
+	protected:
+		int mRows;
+		int mCols;
+		MatrixXr mMemory;
+
+		// only used if states are stored in a file
+		string mFilename;
+		int mFile;
+		real_t* mMapping;
+		size_t mMappingSize;
+
+		inline real_t* data();
+		inline const real_t* data() const;
+
+		void mapFile(int rows, int cols);
+		void unmapFile();
+		bool mapsFile(const string& filename) const;
+};
+
+
+
+inline int ChainStore::rows() const {
+	return mRows;
+}
+
+
+
+inline int ChainStore::cols() const {
+	return mCols;
+}
+
+
+
+inline bool ChainStore::mapped() const {
+	return mFile >= 0;
+}
+
+
+
+inline string ChainStore::filename() const {
+	return mFilename;
+}
+
+
+
+inline real_t* ChainStore::data() {
+	return mapped() ? mMapping : mMemory.data();
+}
+
+
+
+inline const real_t* ChainStore::data() const {
+	return mapped() ? mMapping : mMemory.data();
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef DATASOURCE_H
+#define DATASOURCE_H
+
+#include "Eigen/Core"
+#include "types.h"
+#include <string>
+
+using namespace Eigen;
+using std::string;
+
+// provides access to data points stored in columns; the data points do not have to fit
+// into memory, but are loaded one block of columns at a time
+class DataSource {
+	public:
+		virtual ~DataSource();
+
+		virtual int rows() const = 0;
+		virtual int cols() const = 0;
+
+		// copies a block of data points into memory
+		virtual MatrixXr block(int offset, int numCols) const = 0;
+
+		// asks for a block of data points to be loaded in the background
+		virtual void prefetch(int offset, int numCols) const;
+
+		// returns all data points if they are already stored in a matrix, otherwise 0
+		virtual const MatrixXr* matrix() const;
+
+		// returns a block of data points, only copying them if necessary
+		const MatrixXr& fetch(int offset, int numCols, MatrixXr& buffer) const;
+};
+
+// data points stored in a matrix, which is referenced instead of copied
+class MatrixSource : public DataSource {
+	public:
+		MatrixSource(const MatrixXr& data);
+
+		virtual int rows() const;
+		virtual int cols() const;
+
+		virtual MatrixXr block(int offset, int numCols) const;
+		virtual const MatrixXr* matrix() const;
+
+	protected:
+		const MatrixXr& mData;
+};
+
+// data points stored as single or double precision values in memory owned by someone
+// else; strides are given in bytes, so that row-major arrays can be used as well
+class ArraySource : public DataSource {
+	public:
+		ArraySource(
+			const void* data,
+			int rows,
+			int cols,
+			long rowStride,
+			long colStride,
+			bool singlePrecision = false);
+
+		virtual int rows() const;
+		virtual int cols() const;
+
+		virtual MatrixXr block(int offset, int numCols) const;
+		virtual void prefetch(int offset, int numCols) const;
+
+	protected:
+		const char* mData;
+		int mRows;
+		int mCols;
+		long mRowStride;
+		long mColStride;
+		bool mSinglePrecision;
+
+		ArraySource();
+};
+
+// data points stored column by column in a binary file without header, which is mapped
+// into memory; the operating system only loads the parts which are accessed
+class RawSource : public ArraySource {
+	public:
+		RawSource(const string& filename, int rows, bool singlePrecision = false);
+		virtual ~RawSource();
+
+	protected:
+		void* mMapping;
+		size_t mMappingSize;
+
+		RawSource();
+
+		void map(const string& filename, size_t offset);
+
+	private:
+		RawSource(const RawSource&);
+		RawSource& operator=(const RawSource&);
+};
+
+// data points stored in a two-dimensional array in NumPy's .npy format
+class NpySource : public RawSource {
+	public:
+		NpySource(const string& filename);
+};
+
+#endif
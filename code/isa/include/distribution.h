@@ -2,6 +2,7 @@
 #define DISTRIBUTION_H
 
 #include "Eigen/Core"
+#include "types.h"
 
 using namespace Eigen;
 
@@ -9,9 +10,9 @@ class Distribution {
 	public:
 		virtual ~Distribution();
 
-		virtual int dim() = 0;
-		virtual Array<double, 1, Dynamic> logLikelihood(const MatrixXd& data) = 0;
-		virtual double evaluate(const MatrixXd& data);
+		virtual int dim() const = 0;
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const MatrixXr& data) = 0;
+		virtual double evaluate(const MatrixXr& data);
 };
 
 #endif
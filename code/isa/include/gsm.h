@@ -2,8 +2,10 @@
 #define GSM_H
 
 #include "Eigen/Core"
+#include "types.h"
 #include "distribution.h"
 #include "exception.h"
+#include "rng.h"
 #include <iostream>
 #include <cmath>
 
@@ -14,66 +16,141 @@ class GSM : public Distribution {
 	public:
 		GSM(int dim = 1, int numScales = 10);
 
-		inline int dim();
-		inline int numScales();
+		inline int dim() const;
+		inline int numScales() const;
 
-		inline ArrayXd priors() const;
-		inline void setPriors(MatrixXd priors);
+		inline const ArrayXr& priors() const;
+		inline void setPriors(MatrixXr priors);
 
-		inline ArrayXd scales() const;
-		inline void setScales(MatrixXd scales);
+		inline const ArrayXr& scales() const;
+		inline void setScales(MatrixXr scales);
 
 		inline double variance();
 		inline void normalize();
 
-		virtual bool train(const MatrixXd& data, int maxIter = 100, double tol = 1e-5);
+		inline void seed(unsigned long seed);
 
-		virtual MatrixXd sample(int numSamples = 1);
+		// energies are interpolated from a table if tol is positive; the table is refined until
+		// the error halfway between nodes is below tol, which is not a strict bound
+		inline double energyTableTol() const;
+		void setEnergyTableTol(double tol);
 
-		virtual Array<double, 1, Dynamic> samplePosterior(const MatrixXd& data);
+		virtual bool train(const MatrixXr& data, int maxIter = 100, double tol = 1e-5);
 
-		virtual ArrayXXd posterior(const MatrixXd& data);
-		virtual ArrayXXd posterior(const MatrixXd& data, const RowVectorXd& sqNorms);
+		// the distribution only depends on the squared norms of data points, which can be
+		// passed directly instead of the data points
+		bool trainNorms(const RowVectorXr& sqNorms, int maxIter = 100, double tol = 1e-5);
+		Array<real_t, 1, Dynamic> samplePosteriorNorms(const RowVectorXr& sqNorms, RNG& rng);
 
-		virtual ArrayXXd logJoint(const MatrixXd& data);
-		virtual ArrayXXd logJoint(const MatrixXd& data, const RowVectorXd& sqNorms);
+		// stochastic EM; each iteration blends the statistics of a random batch of data points
+		// into the statistics implied by the current parameters, with a step width which
+		// decays with the number of steps taken so far
+		virtual void trainOnline(
+			const MatrixXr& data,
+			int maxIter = 1,
+			int batchSize = 0,
+			double stepWidth = 1.,
+			double decay = 0.6);
 
-		virtual Array<double, 1, Dynamic> logLikelihood(const MatrixXd& data);
-		virtual Array<double, 1, Dynamic> logLikelihood(const MatrixXd& data, const RowVectorXd& sqNorms);
+		inline int numSteps() const;
+		inline void setNumSteps(int numSteps);
 
-		virtual Array<double, 1, Dynamic> energy(const MatrixXd& data);
-		virtual Array<double, 1, Dynamic> energy(const MatrixXd& data, const RowVectorXd& sqNorms);
+		virtual MatrixXr sample(int numSamples = 1);
+		virtual MatrixXr sample(int numSamples, RNG& rng);
 
-		virtual ArrayXXd energyGradient(const MatrixXd& data);
+		virtual Array<real_t, 1, Dynamic> samplePosterior(const MatrixXr& data);
+		virtual Array<real_t, 1, Dynamic> samplePosterior(const MatrixXr& data, RNG& rng);
+
+		virtual ArrayXXr posterior(const MatrixXr& data);
+		virtual ArrayXXr posterior(const MatrixXr& data, const RowVectorXr& sqNorms);
+
+		virtual ArrayXXr logJoint(const MatrixXr& data);
+		virtual ArrayXXr logJoint(const MatrixXr& data, const RowVectorXr& sqNorms);
+
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const MatrixXr& data);
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const MatrixXr& data, const RowVectorXr& sqNorms);
+
+		virtual Array<real_t, 1, Dynamic> energy(const MatrixXr& data);
+		virtual Array<real_t, 1, Dynamic> energy(const MatrixXr& data, const RowVectorXr& sqNorms);
+
+		virtual ArrayXXr energyGradient(const MatrixXr& data);
+
+		// energies of data points with the given squared norms; optionally also computes
+		// the factors by which the energy gradient scales each data point and the posterior
+		// over scales, all in a single pass over the data
+		void computeEnergy(
+			const RowVectorXr& sqNorms,
+			Array<real_t, 1, Dynamic>& energy,
+			Array<real_t, 1, Dynamic>* gradientScales = 0,
+			ArrayXXr* posterior = 0) const;
 
 	protected:
 		int mDim;
 		int mNumScales;
-		ArrayXd mPriors;
-		ArrayXd mScales;
+		ArrayXr mPriors;
+		ArrayXr mScales;
+		RNG mRNG;
+
+		// number of stochastic EM steps taken
+		int mNumSteps;
+
+		// energy and its first two derivatives with respect to the squared norm, tabulated
+		// at equidistant squared norms; empty if energies are computed exactly
+		double mTableTol;
+		real_t mTableStep;
+		ArrayXr mTableEnergy;
+		ArrayXr mTableSlope;
+		ArrayXr mTableCurvature;
+
+		// average posterior over scales and average posterior-weighted squared norm, which
+		// are sufficient for EM; returns the average log-likelihood of the data
+		double computeStatistics(
+			const RowVectorXr& sqNorms,
+			ArrayXd& postMean,
+			ArrayXd& postNormMean) const;
+
+		void updateParameters(const ArrayXd& postMean, const ArrayXd& postNormMean);
+
+		// kernels for a number of scales known at compile time, or Dynamic
+		template <int NumScales>
+		void computeEnergyKernel(
+			const RowVectorXr& sqNorms,
+			Array<real_t, 1, Dynamic>& energy,
+			Array<real_t, 1, Dynamic>* gradientScales,
+			ArrayXXr* posterior) const;
+		template <int NumScales>
+		Array<real_t, 1, Dynamic> samplePosteriorKernel(const RowVectorXr& sqNorms, RNG& rng) const;
+		template <int NumScales>
+		double computeStatisticsKernel(
+			const RowVectorXr& sqNorms,
+			ArrayXd& postMean,
+			ArrayXd& postNormMean) const;
+
+		void updateEnergyTable();
+		void tabulateEnergy(int numNodes, real_t maxSqNorm);
 };
 
 
 
-inline int GSM::dim() {
+inline int GSM::dim() const {
 	return mDim;
 }
 
 
 
-inline int GSM::numScales() {
+inline int GSM::numScales() const {
 	return mNumScales;
 }
 
 
 
-inline ArrayXd GSM::priors() const {
+inline const ArrayXr& GSM::priors() const {
 	return mPriors;
 }
 
 
 
-inline void GSM::setPriors(MatrixXd priors) {
+inline void GSM::setPriors(MatrixXr priors) {
 	// turn row vector into column vector
 	if(priors.cols() > priors.rows())
 		priors.transposeInPlace();
@@ -82,11 +159,12 @@ inline void GSM::setPriors(MatrixXd priors) {
 		throw Exception("Wrong number of prior weights.");
 
 	mPriors = priors / priors.sum();
+	updateEnergyTable();
 }
 
 
 
-inline ArrayXd GSM::scales() const {
+inline const ArrayXr& GSM::scales() const {
 	return mScales;
 }
 
@@ -100,11 +178,36 @@ inline double GSM::variance() {
 
 inline void GSM::normalize() {
 	mScales /= sqrt(variance());
+	updateEnergyTable();
+}
+
+
+
+inline void GSM::seed(unsigned long seed) {
+	mRNG.seed(seed);
+}
+
+
+
+inline int GSM::numSteps() const {
+	return mNumSteps;
+}
+
+
+
+inline void GSM::setNumSteps(int numSteps) {
+	mNumSteps = numSteps;
+}
+
+
+
+inline double GSM::energyTableTol() const {
+	return mTableTol;
 }
 
 
 
-inline void GSM::setScales(MatrixXd scales) {
+inline void GSM::setScales(MatrixXr scales) {
 	// turn row vector into column vector
 	if(scales.cols() > scales.rows())
 		scales.transposeInPlace();
@@ -113,6 +216,7 @@ inline void GSM::setScales(MatrixXd scales) {
 		throw Exception("Wrong number of scales.");
 
 	mScales = scales;
+	updateEnergyTable();
 }
 
 #endif
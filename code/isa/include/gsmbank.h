@@ -0,0 +1,64 @@
+#ifndef GSMBANK_H
+#define GSMBANK_H
+
+#include "Eigen/Core"
+#include "types.h"
+#include "gsm.h"
+#include "rng.h"
+#include <vector>
+
+using namespace Eigen;
+using std::vector;
+
+// parameters of many GSMs of the same shape stored side by side, so that all subspaces
+// of a model can be evaluated with one kernel operating on whole blocks of hidden states
+class GSMBank {
+	public:
+		GSMBank(const vector<GSM>& subspaces);
+
+		// tests whether all subspaces have the same dimensionality and number of scales
+		// and whether their energies are computed exactly
+		static bool compatible(const vector<GSM>& subspaces);
+
+		inline int dim() const;
+		inline int numScales() const;
+		inline int numSubspaces() const;
+
+		// energies of hidden states summed over subspaces and, optionally, their gradient
+		void computeEnergy(
+			const MatrixXr& states,
+			Array<real_t, 1, Dynamic>& energy,
+			MatrixXr* gradient = 0) const;
+
+		// samples scales from the posterior of each subspace, one value per hidden unit
+		void sampleScales(const MatrixXr& states, MatrixXr& scales, RNG& rng) const;
+
+	protected:
+		int mDim;
+		int mNumScales;
+
+		// one row per subspace, one column per scale
+		ArrayXXr mLogWeights;
+		ArrayXXr mPrecisions;
+		ArrayXXr mScales;
+};
+
+
+
+inline int GSMBank::dim() const {
+	return mDim;
+}
+
+
+
+inline int GSMBank::numScales() const {
+	return mNumScales;
+}
+
+
+
+inline int GSMBank::numSubspaces() const {
+	return mLogWeights.rows();
+}
+
+#endif
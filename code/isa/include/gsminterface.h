@@ -19,7 +19,9 @@ extern PyTypeObject GSM_type;
 extern const char* GSM_doc;
 extern const char* GSM_variance_doc;
 extern const char* GSM_normalize_doc;
+extern const char* GSM_seed_doc;
 extern const char* GSM_train_doc;
+extern const char* GSM_partial_fit_doc;
 extern const char* GSM_posterior_doc;
 extern const char* GSM_sample_doc;
 extern const char* GSM_sample_posterior_doc;
@@ -43,7 +45,10 @@ int GSM_set_scales(GSMObject*, PyObject*, void*);
 PyObject* GSM_variance(GSMObject*, PyObject*, PyObject*);
 PyObject* GSM_normalize(GSMObject*, PyObject*, PyObject*);
 
+PyObject* GSM_seed(GSMObject*, PyObject*, PyObject*);
+
 PyObject* GSM_train(GSMObject*, PyObject*, PyObject*);
+PyObject* GSM_partial_fit(GSMObject*, PyObject*, PyObject*);
 
 PyObject* GSM_posterior(GSMObject*, PyObject*, PyObject*);
 
@@ -2,10 +2,18 @@
 #define ISA_H
 
 #include "Eigen/Core"
+#include "types.h"
+#include "Eigen/Cholesky"
 #include "distribution.h"
 #include "gsm.h"
+#include "gsmbank.h"
+#include "rng.h"
+#include "batchllt.h"
+#include "chainstore.h"
+#include "datasource.h"
 #include <string>
 #include <vector>
+#include <utility>
 #include <iostream>
 
 using namespace Eigen;
@@ -34,6 +42,7 @@ class ISA : public Distribution {
 				bool mergeSubspaces;
 				bool persistent;
 				bool orthogonalize;
+				double energyTableTol;
 				Callback* callback;
 
 				struct {
@@ -62,12 +71,17 @@ class ISA : public Distribution {
 				struct {
 					int maxIter;
 					double tol;
+					int batchSize;
+					double stepWidth;
+					double decay;
 				} gsm;
 
 				struct {
 					int verbosity;
 					int iniIter;
 					int numIter;
+					int cacheSize;
+					int blockSize;
 				} gibbs;
 
 				struct {
@@ -92,80 +106,179 @@ class ISA : public Distribution {
 		ISA(int numVisibles, int numHiddens = -1, int sSize = 1, int numScales = 10);
 		virtual ~ISA();
 
-		inline int dim();
+		inline int dim() const;
 		inline int numVisibles();
 		inline int numHiddens();
 		inline bool complete();
 		inline int numSubspaces();
 
-		inline vector<GSM> subspaces();
+		inline const vector<GSM>& subspaces() const;
 		inline void setSubspaces(vector<GSM> subspaces);
 
-		inline MatrixXd basis();
-		inline void setBasis(const MatrixXd& basis);
+		inline const MatrixXr& basis() const;
+		inline void setBasis(const MatrixXr& basis);
+		inline void setBasis(MatrixXr&& basis);
+
+		// refers to the states in memory or in the mapped file
+		inline Map<const MatrixXr> hiddenStates() const;
+		inline void setHiddenStates(const MatrixXr& hiddenStates);
+		inline void setHiddenStates(MatrixXr&& hiddenStates);
+		inline string hiddenStatesFile();
+
+		virtual void mapHiddenStates(const string& filename);
+
+		// reads states stored in a file into memory without mapping the file
+		virtual void loadHiddenStates(const string& filename);
+		virtual void unmapHiddenStates();
 
-		inline MatrixXd hiddenStates();
-		inline void setHiddenStates(const MatrixXd& hiddenStates);
+		inline void seed(unsigned long seed);
 
-		virtual MatrixXd nullspaceBasis();
+		virtual MatrixXr nullspaceBasis();
+		virtual MatrixXr nullspaceProjector();
 
 		virtual void initialize();
-		virtual void initialize(const MatrixXd& data);
+		virtual void initialize(const MatrixXr& data);
+		virtual void initialize(const DataSource& data);
 
 		virtual void orthogonalize();
 
-		virtual void train(const MatrixXd& data, Parameters params = Parameters());
+		virtual void train(const MatrixXr& data, Parameters params = Parameters());
+		virtual void train(const DataSource& data, Parameters params = Parameters());
 		virtual void trainPrior(
-			const MatrixXd& states,
+			const MatrixXr& states,
 			const Parameters& params = Parameters());
 		virtual bool trainSGD(
-			const MatrixXd& complData,
-			const MatrixXd& complBasis,
+			const MatrixXr& complData,
+			const MatrixXr& complBasis,
 			const Parameters& params = Parameters());
 		virtual bool trainLBFGS(
-			const MatrixXd& complData,
-			const MatrixXd& complBasis,
+			const MatrixXr& complData,
+			const MatrixXr& complBasis,
 			const Parameters& params = Parameters());
 		virtual void trainMP(
-			const MatrixXd& data,
+			const MatrixXr& data,
 			const Parameters& params = Parameters());
-		virtual MatrixXd mergeSubspaces(MatrixXd states, const Parameters& params = Parameters());
-
-		virtual MatrixXd sample(int numSamples = 1);
-		virtual MatrixXd samplePrior(int numSamples = 1);
-		virtual MatrixXd sampleScales(const MatrixXd& states);
-		virtual MatrixXd samplePosterior(
-			const MatrixXd& data,
-			const MatrixXd& states,
+		virtual MatrixXr mergeSubspaces(MatrixXr states, const Parameters& params = Parameters());
+
+		virtual MatrixXr sample(int numSamples = 1);
+		virtual MatrixXr samplePrior(int numSamples = 1);
+		virtual MatrixXr sampleScales(const MatrixXr& states);
+
+		// write into the given matrices, reusing their memory if they already have the right size
+		virtual void samplePriorInto(MatrixXr& states, int numSamples = 1);
+		virtual void sampleScalesInto(MatrixXr& scales, const MatrixXr& states);
+		virtual MatrixXr samplePosterior(
+			const MatrixXr& data,
+			const MatrixXr& states,
 			const Parameters& params = Parameters());
-		virtual pair<MatrixXd, MatrixXd> samplePosteriorAIS(
-			const MatrixXd& data,
+		virtual pair<MatrixXr, MatrixXr> samplePosteriorAIS(
+			const MatrixXr& data,
 			const Parameters& params = Parameters());
-		virtual MatrixXd samplePosterior(const MatrixXd& data, const Parameters& params = Parameters());
-		virtual MatrixXd sampleNullspace(const MatrixXd& data, const Parameters& params = Parameters());
-		virtual MatrixXd sampleAIS(const MatrixXd& data, const Parameters& params = Parameters());
+		virtual pair<MatrixXr, MatrixXr> samplePosteriorAIS(
+			const MatrixXr& data,
+			const Parameters& params,
+			RNG& rng);
+		virtual MatrixXr samplePosterior(const MatrixXr& data, const Parameters& params = Parameters());
+		virtual MatrixXr samplePosterior(const DataSource& data, const Parameters& params = Parameters());
+		virtual MatrixXr samplePosterior(
+			const DataSource& data,
+			const MatrixXr& states,
+			const Parameters& params = Parameters());
+		virtual MatrixXr sampleNullspace(const MatrixXr& data, const Parameters& params = Parameters());
+		virtual MatrixXr sampleAIS(const MatrixXr& data, const Parameters& params = Parameters());
 
-		virtual MatrixXd matchingPursuit(const MatrixXd& data, const Parameters& params = Parameters());
+		virtual MatrixXr matchingPursuit(const MatrixXr& data, const Parameters& params = Parameters());
 
-		virtual MatrixXd priorLogLikelihood(const MatrixXd& states);
-		virtual MatrixXd priorEnergy(const MatrixXd& states);
-		virtual MatrixXd priorEnergyGradient(const MatrixXd& states);
+		virtual MatrixXr priorLogLikelihood(const MatrixXr& states);
+		virtual MatrixXr priorEnergy(const MatrixXr& states);
+		virtual MatrixXr priorEnergyGradient(const MatrixXr& states);
+		virtual void priorEnergyGradientInto(MatrixXr& gradient, const MatrixXr& states);
+		virtual pair<MatrixXr, MatrixXr> priorEnergyAndGradient(const MatrixXr& states);
 
-		virtual Array<double, 1, Dynamic> logLikelihood(const MatrixXd& data);
-		virtual Array<double, 1, Dynamic> logLikelihood(const MatrixXd& data, const Parameters& params);
-		virtual double evaluate(const MatrixXd& data, const Parameters& params = Parameters());
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const MatrixXr& data);
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const MatrixXr& data, const Parameters& params);
+		virtual Array<real_t, 1, Dynamic> logLikelihood(const DataSource& data, const Parameters& params);
+		virtual double evaluate(const MatrixXr& data, const Parameters& params = Parameters());
+		virtual double evaluate(const DataSource& data, const Parameters& params = Parameters());
 
 	protected:
+		// quantities which only depend on the basis
+		struct BasisCache {
+			int version;
+			int nullspaceVersion;
+			MatrixXr rowBasis;
+			MatrixXr nullspaceBasis;
+			MatrixXr nullspaceProjector;
+			LLT<MatrixXr> basisLLT;
+			MatrixXr basisInverse;
+			double logDet;
+
+			BasisCache();
+		};
+
 		int mNumVisibles;
 		int mNumHiddens;
-		MatrixXd mBasis;
+		MatrixXr mBasis;
 		vector<GSM> mSubspaces;
-		MatrixXd mHiddenStates;
+		ChainStore mHiddenStates;
+		RNG mRNG;
+		int mBasisVersion;
+		BasisCache mBasisCache;
+
+		// copies the basis and the prior but not the states of the Markov chain, which may be
+		// large and stored in a file; used for proposal distributions
+		ISA(const ISA& isa, const RNG& rng);
+
+		inline void invalidateCache();
+		const BasisCache& basisCache(bool withNullspaceBasis = false);
+		void updateNullspaceBasis();
+
+		void sampleHiddenStates(const DataSource& data, const Parameters& params, bool persistent);
+		void trainPrior(const Map<MatrixXr>& states, const Parameters& params);
+		void trainBasis(const MatrixXr& data, const Map<MatrixXr>& states, Parameters& params);
+
+		// stochastic gradient descent on blocks of data which do not fit into memory at once;
+		// the basis is evaluated and the step width adapted after each pass through the data
+		void trainBasis(const DataSource& data, Parameters& params);
+		void completeDataBlock(
+			MatrixXr& complData,
+			const DataSource& data,
+			const MatrixXr& nullBasis,
+			int offset,
+			int numCols,
+			MatrixXr& buffer);
+
+		// one pass of stochastic gradient descent through the given data points
+		void updateFilterSGD(
+			MatrixXr& W,
+			MatrixXr& P,
+			const MatrixXr& complData,
+			const Parameters& params,
+			MatrixXr& X,
+			MatrixXr& Y,
+			MatrixXr& G);
+		void setEnergyTableTol(double tol);
+
+		// energies of hidden states summed over subspaces and, optionally, their gradient
+		void computePriorEnergy(
+			const MatrixXr& states,
+			Array<real_t, 1, Dynamic>& energy,
+			MatrixXr* gradient = 0);
+
+		void sampleSources(
+			MatrixXr& states,
+			const MatrixXr& data,
+			const MatrixXr& WX,
+			const MatrixXr& variances,
+			BatchLLT& solver,
+			bool nullspace,
+			RNG& rng);
+		bool useNullspaceCoordinates(const Parameters& params);
 };
 
 
 
-inline int ISA::dim() {
+inline int ISA::dim() const {
 	return mNumVisibles;
 }
 
@@ -195,11 +308,12 @@ inline int ISA::numSubspaces() {
 
 
 
-inline vector<GSM> ISA::subspaces() {
+inline const vector<GSM>& ISA::subspaces() const {
 	return mSubspaces;
 }
 
 
+
 inline void ISA::setSubspaces(vector<GSM> subspaces) {
 	int dim = 0;
 	for(size_t i = 0; i < subspaces.size(); ++i)
@@ -208,34 +322,72 @@ inline void ISA::setSubspaces(vector<GSM> subspaces) {
 	if(dim != numHiddens())
 		throw Exception("Subspace dimensionality should correspond to the number of hidden units.");
 
-	mSubspaces = subspaces;
+	mSubspaces = std::move(subspaces);
 }
 
 
 
-inline MatrixXd ISA::basis() {
+inline const MatrixXr& ISA::basis() const {
 	return mBasis;
 }
 
 
 
-inline void ISA::setBasis(const MatrixXd& basis) {
+inline void ISA::setBasis(const MatrixXr& basis) {
 	if(basis.rows() != numVisibles() && basis.cols() != numHiddens())
 		throw Exception("Basis has wrong dimensionality.");
 
 	mBasis = basis;
+
+	invalidateCache();
+}
+
+
+
+inline void ISA::setBasis(MatrixXr&& basis) {
+	if(basis.rows() != numVisibles() && basis.cols() != numHiddens())
+		throw Exception("Basis has wrong dimensionality.");
+
+	// Eigen matrices have no move constructor, but swapping only exchanges pointers
+	mBasis.swap(basis);
+
+	invalidateCache();
 }
 
 
 
-inline MatrixXd ISA::hiddenStates() {
-	return mHiddenStates;
+inline Map<const MatrixXr> ISA::hiddenStates() const {
+	return mHiddenStates.matrix();
 }
 
 
 
-inline void ISA::setHiddenStates(const MatrixXd& hiddenStates) {
+inline void ISA::setHiddenStates(const MatrixXr& hiddenStates) {
 	mHiddenStates = hiddenStates;
 }
 
+
+
+inline void ISA::setHiddenStates(MatrixXr&& hiddenStates) {
+	mHiddenStates = std::move(hiddenStates);
+}
+
+
+
+inline string ISA::hiddenStatesFile() {
+	return mHiddenStates.filename();
+}
+
+
+
+inline void ISA::seed(unsigned long seed) {
+	mRNG.seed(seed);
+}
+
+
+
+inline void ISA::invalidateCache() {
+	++mBasisVersion;
+}
+
 #endif
@@ -19,10 +19,13 @@ extern const char* ISA_doc;
 extern const char* ISA_basis_doc;
 extern const char* ISA_set_basis_doc;
 extern const char* ISA_nullspace_basis_doc;
+extern const char* ISA_nullspace_projector_doc;
 extern const char* ISA_hidden_states_doc;
 extern const char* ISA_set_hidden_states_doc;
+extern const char* ISA_map_hidden_states_doc;
 extern const char* ISA_subspaces_doc;
 extern const char* ISA_set_subspaces_doc;
+extern const char* ISA_seed_doc;
 extern const char* ISA_default_parameters_doc;
 extern const char* ISA_initialize_doc;
 extern const char* ISA_orthogonalize_doc;
@@ -60,13 +63,17 @@ int ISA_set_gaussianity(ISAObject*, PyObject* value, void*);
 PyObject* ISA_basis(ISAObject*, PyObject*, PyObject*);
 PyObject* ISA_set_basis(ISAObject*, PyObject*, PyObject*);
 PyObject* ISA_nullspace_basis(ISAObject*, PyObject*, PyObject*);
+PyObject* ISA_nullspace_projector(ISAObject*, PyObject*, PyObject*);
 
 PyObject* ISA_hidden_states(ISAObject*, PyObject*, PyObject*);
 PyObject* ISA_set_hidden_states(ISAObject*, PyObject*, PyObject*);
+PyObject* ISA_map_hidden_states(ISAObject*, PyObject*, PyObject*);
 
 PyObject* ISA_subspaces(ISAObject*, PyObject*, PyObject*);
 PyObject* ISA_set_subspaces(ISAObject*, PyObject*, PyObject*);
 
+PyObject* ISA_seed(ISAObject*, PyObject*, PyObject*);
+
 PyObject* ISA_default_parameters(ISAObject*);
 
 PyObject* ISA_initialize(ISAObject*, PyObject*, PyObject*);
@@ -0,0 +1,43 @@
+#ifndef MEMORYPOOL_H
+#define MEMORYPOOL_H
+
+#include <cstddef>
+
+using std::size_t;
+
+// keeps memory blocks freed by Eigen objects for reuse instead of returning them to the
+// system; each thread has its own free lists, whose locks are only contended when a scope
+// ends. blocks are only kept while a scope exists, and Eigen only allocates through the pool if compiled with
+// EIGEN_USER_ALIGNED_MALLOC
+class MemoryPool {
+	public:
+		// enables reuse of memory blocks during its lifetime; cached blocks of all threads
+		// are released when the outermost scope ends
+		class Scope {
+			public:
+				Scope();
+				~Scope();
+
+			private:
+				Scope(const Scope&);
+				Scope& operator=(const Scope&);
+		};
+
+		struct Statistics {
+			// number of requests for memory
+			long numAllocations;
+
+			// number of requests served with blocks kept by the pool
+			long numReused;
+		};
+
+		// returned memory is aligned to 16 bytes
+		static void* allocate(size_t size);
+		static void* reallocate(void* ptr, size_t size);
+		static void release(void* ptr);
+
+		// counts requests of all threads since the program started
+		static Statistics statistics();
+};
+
+#endif
@@ -7,10 +7,85 @@
 #include <Python.h>
 #include <arrayobject.h>
 #include "Eigen/Core"
+#include "types.h"
+#include "datasource.h"
 
 using namespace Eigen;
 
-PyObject* PyArray_FromMatrixXd(const MatrixXd& mat);
-MatrixXd PyArray_ToMatrixXd(PyObject* array);
+// NumPy type corresponding to the precision of the model
+#if ISA_FLOAT == 32
+#define NPY_REAL NPY_FLOAT
+#else
+#define NPY_REAL NPY_DOUBLE
+#endif
+
+// results which are no longer needed are handed over to NumPy without copying them
+PyObject* PyArray_FromMatrixXr(const MatrixXr& mat);
+PyObject* PyArray_FromMatrixXr(MatrixXr&& mat);
+
+// writes a result into an array provided by the caller instead, which has to be writeable and
+// of the right shape and precision; returns a new reference to that array
+PyObject* PyArray_FromMatrixXr(MatrixXr&& mat, PyObject* out);
+
+// throws an exception if a result of the given shape cannot be written into the output array,
+// so that the array can be checked before anything is computed; 0 and None are accepted
+void PyArray_CheckOutput(PyObject* out, int rows, int cols);
+
+// arrays of any memory layout are read in place and converted in a single pass
+MatrixXr PyArray_ToMatrixXr(PyObject* array);
+
+// wraps data points stored in a NumPy array or in a .npy file without copying them;
+// returns 0 if the object cannot be converted into an array
+DataSource* PyObject_ToDataSource(PyObject* data);
+
+// releases the global interpreter lock during its lifetime, so that other Python threads can
+// run while a model is busy; no Python objects may be touched while it exists
+class AllowThreads {
+	public:
+		inline AllowThreads();
+		inline ~AllowThreads();
+
+	private:
+		PyThreadState* mState;
+
+		AllowThreads(const AllowThreads&);
+		AllowThreads& operator=(const AllowThreads&);
+};
+
+// acquires the global interpreter lock during its lifetime, whether or not the calling
+// thread already holds it
+class EnsureGIL {
+	public:
+		inline EnsureGIL();
+		inline ~EnsureGIL();
+
+	private:
+		PyGILState_STATE mState;
+
+		EnsureGIL(const EnsureGIL&);
+		EnsureGIL& operator=(const EnsureGIL&);
+};
+
+
+
+inline AllowThreads::AllowThreads() : mState(PyEval_SaveThread()) {
+}
+
+
+
+inline AllowThreads::~AllowThreads() {
+	PyEval_RestoreThread(mState);
+}
+
+
+
+inline EnsureGIL::EnsureGIL() : mState(PyGILState_Ensure()) {
+}
+
+
+
+inline EnsureGIL::~EnsureGIL() {
+	PyGILState_Release(mState);
+}
 
 #endif
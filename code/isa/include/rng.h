@@ -0,0 +1,46 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include "Eigen/Core"
+#include "types.h"
+#include <stdint.h>
+
+using namespace Eigen;
+
+// counter-based random number generator (Philox-4x32-10); the n-th number of a stream
+// only depends on the seed and on n, so that parallel loops produce identical results
+// independent of the number of threads
+class RNG {
+	public:
+		RNG();
+		RNG(unsigned long seed);
+
+		void seed(unsigned long seed);
+
+		RNG split();
+
+		ArrayXXr uniform(int m = 1, int n = 1);
+		ArrayXXr normal(int m = 1, int n = 1);
+		ArrayXXr gamma(int m = 1, int n = 1, int k = 1);
+
+		// reserves blocks of random bits which can later be generated in any order, so that
+		// loops can draw random numbers on demand instead of storing them in arrays
+		uint64_t reserve(uint64_t numBlocks);
+		void generate(uint64_t counter, uint32_t stream, uint32_t result[4]) const;
+
+		// maps 64 random bits onto the open interval (0, 1)
+		static inline double toUniform(uint32_t hi, uint32_t lo);
+
+	protected:
+		uint32_t mKey[2];
+		uint64_t mCounter;
+};
+
+
+
+inline double RNG::toUniform(uint32_t hi, uint32_t lo) {
+	uint64_t bits = (static_cast<uint64_t>(hi) << 32 | lo) >> 11;
+	return (bits + 0.5) / 9007199254740992.;
+}
+
+#endif
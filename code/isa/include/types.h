@@ -0,0 +1,30 @@
+#ifndef TYPES_H
+#define TYPES_H
+
+#include "Eigen/Core"
+
+// precision of data and model parameters, either single (32) or double (64)
+#ifndef ISA_FLOAT
+#define ISA_FLOAT 64
+#endif
+
+// libLBFGS has to be compiled with the same precision, which is verified before training
+#ifndef LBFGS_FLOAT
+#define LBFGS_FLOAT ISA_FLOAT
+#endif
+
+#if ISA_FLOAT == 32
+typedef float real_t;
+#elif ISA_FLOAT == 64
+typedef double real_t;
+#else
+#error "ISA supports single (ISA_FLOAT = 32) or double (ISA_FLOAT = 64) precision only."
+#endif
+
+typedef Eigen::Matrix<real_t, Eigen::Dynamic, Eigen::Dynamic> MatrixXr;
+typedef Eigen::Matrix<real_t, Eigen::Dynamic, 1> VectorXr;
+typedef Eigen::Matrix<real_t, 1, Eigen::Dynamic> RowVectorXr;
+typedef Eigen::Array<real_t, Eigen::Dynamic, Eigen::Dynamic> ArrayXXr;
+typedef Eigen::Array<real_t, Eigen::Dynamic, 1> ArrayXr;
+
+#endif
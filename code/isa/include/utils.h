@@ -2,6 +2,7 @@
 #define UTILS_H
 
 #include "Eigen/Core"
+#include "types.h"
 #include <vector>
 
 using namespace Eigen;
@@ -9,20 +10,17 @@ using std::vector;
 
 #define PI 3.141592653589793
 
-Array<double, 1, Dynamic> logsumexp(const ArrayXXd& array);
-Array<double, 1, Dynamic> logmeanexp(const ArrayXXd& array);
+Array<real_t, 1, Dynamic> logsumexp(const ArrayXXr& array);
+Array<real_t, 1, Dynamic> logmeanexp(const ArrayXXr& array);
 
-ArrayXXd sampleNormal(int m = 1, int n = 1);
-ArrayXXd sampleGamma(int m = 1, int n = 1, int k = 1);
+VectorXi argsort(const VectorXr& data);
+MatrixXr covariance(const MatrixXr& data);
+MatrixXr corrcoef(const MatrixXr& data);
+MatrixXr normalize(const MatrixXr& matrix);
 
-VectorXi argsort(const VectorXd& data);
-MatrixXd covariance(const MatrixXd& data);
-MatrixXd corrcoef(const MatrixXd& data);
-MatrixXd normalize(const MatrixXd& matrix);
+double logDetPD(const MatrixXr& matrix);
 
-double logDetPD(const MatrixXd& matrix);
-
-MatrixXd deleteRows(const MatrixXd& matrix, vector<int> indices);
-MatrixXd deleteCols(const MatrixXd& matrix, vector<int> indices);
+MatrixXr deleteRows(const MatrixXr& matrix, vector<int> indices);
+MatrixXr deleteCols(const MatrixXr& matrix, vector<int> indices);
 
 #endif
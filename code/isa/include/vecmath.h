@@ -0,0 +1,32 @@
+#ifndef VECMATH_H
+#define VECMATH_H
+
+#include "Eigen/Core"
+
+using namespace Eigen;
+
+// exponentials and logarithms of contiguous arrays; input and output may coincide.
+// double precision values are processed with AVX2 or SSE2 instructions, depending on
+// what the processor supports, single precision values with Eigen's packet functions
+void vexp(const double* input, double* output, int size);
+void vlog(const double* input, double* output, int size);
+
+inline void vexp(const float* input, float* output, int size);
+inline void vlog(const float* input, float* output, int size);
+
+// name of the instruction set used for double precision values
+const char* vecmathInstructionSet();
+
+
+
+inline void vexp(const float* input, float* output, int size) {
+	Map<ArrayXf>(output, size) = Map<const ArrayXf>(input, size).exp();
+}
+
+
+
+inline void vlog(const float* input, float* output, int size) {
+	Map<ArrayXf>(output, size) = Map<const ArrayXf>(input, size).log();
+}
+
+#endif
@@ -0,0 +1,123 @@
+// kernels of vecmath.cpp written in terms of a packet type P, which provides arithmetic on
+// a number of doubles; this file is included once for each instruction set, with code
+// generation for that instruction set enabled
+
+// exponential function based on Cephes' exp, with a relative error of about 1 ulp
+template <class P>
+inline void expKernel(const double* input, double* output, int size) {
+	typedef typename P::Type Packet;
+
+	double buffer[P::size];
+
+	for(int i = 0; i < size; i += P::size) {
+		bool tail = i + P::size > size;
+
+		// the remainder is processed as a padded packet, so that all values are treated alike
+		if(tail) {
+			std::fill(buffer, buffer + P::size, 0.);
+			std::copy(input + i, input + size, buffer);
+		}
+
+		Packet x = P::load(tail ? buffer : input + i);
+
+		// NaNs are passed through, values outside this range under- or overflow
+		x = P::min(P::set1(710.), P::max(P::set1(-746.), x));
+
+		// x = n log(2) + r with |r| <= log(2) / 2
+		Packet n = P::round(P::mul(x, P::set1(1.4426950408889634073599)));
+		Packet r = P::sub(x, P::mul(n, P::set1(6.93145751953125e-1)));
+		r = P::sub(r, P::mul(n, P::set1(1.42860682030941723212e-6)));
+
+		// Pade approximation of exp(r)
+		Packet rr = P::mul(r, r);
+		Packet px = P::madd(rr, P::set1(1.26177193074810590878e-4), P::set1(3.02994407707441961300e-2));
+		px = P::mul(r, P::madd(px, rr, P::set1(9.99999999999999999910e-1)));
+		Packet qx = P::madd(rr, P::set1(3.00198505138664455042e-6), P::set1(2.52448340349684104192e-3));
+		qx = P::madd(qx, rr, P::set1(2.27265548208155028766e-1));
+		qx = P::madd(qx, rr, P::set1(2.00000000000000000009e0));
+		Packet y = P::madd(P::set1(2.), P::div(px, P::sub(qx, px)), P::set1(1.));
+
+		// 2^n is applied in two steps, so that results may be subnormal or infinite; the
+		// exponent fields of 2^n1 and 2^n2 are written by adding n1 and n2 to 2^52 + 1023
+		Packet n1 = P::round(P::mul(n, P::set1(0.5)));
+		Packet n2 = P::sub(n, n1);
+		Packet bias = P::set1(4503599627370496. + 1023.);
+		y = P::mul(y, P::shiftLeft52(P::add(n1, bias)));
+		y = P::mul(y, P::shiftLeft52(P::add(n2, bias)));
+
+		if(tail) {
+			P::store(buffer, y);
+			std::copy(buffer, buffer + size - i, output + i);
+		} else {
+			P::store(output + i, y);
+		}
+	}
+}
+
+
+
+// natural logarithm based on Cephes' log, with a relative error of about 1 ulp
+template <class P>
+inline void logKernel(const double* input, double* output, int size) {
+	typedef typename P::Type Packet;
+
+	double buffer[P::size];
+
+	for(int i = 0; i < size; i += P::size) {
+		bool tail = i + P::size > size;
+
+		if(tail) {
+			std::fill(buffer, buffer + P::size, 1.);
+			std::copy(input + i, input + size, buffer);
+		}
+
+		Packet value = P::load(tail ? buffer : input + i);
+
+		// subnormal values are scaled into the normal range
+		Packet subnormal = P::lt(value, P::set1(2.2250738585072014e-308));
+		Packet x = P::select(subnormal, P::mul(value, P::set1(18014398509481984.)), value);
+
+		// x = m 2^e with 0.5 <= m < 1, the exponent field is turned into a double by
+		// placing it into the mantissa of 2^52
+		Packet e = P::bitOr(P::shiftRight52(x), P::bits(0x4330000000000000LL));
+		e = P::sub(e, P::set1(4503599627370496. + 1022.));
+		e = P::sub(e, P::bitAnd(subnormal, P::set1(54.)));
+		Packet m = P::bitOr(P::bitAnd(x, P::bits(0x000FFFFFFFFFFFFFLL)), P::set1(0.5));
+
+		// f = m - 1 or f = 2m - 1, whichever lies in [sqrt(1/2) - 1, sqrt(2) - 1)
+		Packet small = P::lt(m, P::set1(0.70710678118654752440));
+		e = P::sub(e, P::bitAnd(small, P::set1(1.)));
+		Packet f = P::sub(P::select(small, P::add(m, m), m), P::set1(1.));
+
+		// rational approximation of log(1 + f)
+		Packet ff = P::mul(f, f);
+		Packet px = P::madd(f, P::set1(1.01875663804580931796e-4), P::set1(4.97494994976747001425e-1));
+		px = P::madd(px, f, P::set1(4.70579119878881725854e0));
+		px = P::madd(px, f, P::set1(1.44989225341610930846e1));
+		px = P::madd(px, f, P::set1(1.79368678507819816313e1));
+		px = P::madd(px, f, P::set1(7.70838733755885391666e0));
+		Packet qx = P::add(f, P::set1(1.12873587189167450590e1));
+		qx = P::madd(qx, f, P::set1(4.52279145837532221105e1));
+		qx = P::madd(qx, f, P::set1(8.29875266912776603211e1));
+		qx = P::madd(qx, f, P::set1(7.11544750618563894466e1));
+		qx = P::madd(qx, f, P::set1(2.31251620126765340583e1));
+
+		Packet y = P::mul(f, P::mul(ff, P::div(px, qx)));
+		y = P::sub(y, P::mul(e, P::set1(2.121944400546905827679e-4)));
+		y = P::sub(y, P::mul(ff, P::set1(0.5)));
+		y = P::add(P::add(f, y), P::mul(e, P::set1(0.693359375)));
+
+		// special values
+		Packet inf = P::set1(HUGE_VAL);
+		y = P::select(P::eq(value, inf), inf, y);
+		y = P::select(P::eq(value, P::set1(0.)), P::set1(-HUGE_VAL), y);
+		y = P::bitOr(y, P::nge(value, P::set1(0.)));
+
+		if(tail) {
+			P::store(buffer, y);
+			std::copy(buffer, buffer + size - i, output + i);
+		} else {
+			P::store(output + i, y);
+		}
+	}
+}
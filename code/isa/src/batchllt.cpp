@@ -0,0 +1,416 @@
+#include "batchllt.h"
+#include <algorithm>
+#include <cmath>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using std::min;
+using std::max;
+using std::sqrt;
+using std::pair;
+using std::make_pair;
+
+// hashes the bit patterns of a vector of variances
+static size_t hashColumn(const MatrixXr& matrix, int col) {
+	const unsigned char* bytes = reinterpret_cast<const unsigned char*>(matrix.col(col).data());
+
+	// FNV-1a
+	size_t hash = 2166136261u;
+	for(size_t i = 0; i < matrix.rows() * sizeof(real_t); ++i)
+		hash = (hash ^ bytes[i]) * 16777619u;
+
+	return hash;
+}
+
+
+
+BatchLLT::BatchLLT(const MatrixXr& basis, int cacheSize) :
+	mDim(basis.rows()),
+	mNumPairs(basis.rows() * (basis.rows() + 1) / 2),
+	mBasis(basis),
+	mCacheSize(cacheSize),
+	mNumHits(0),
+	mNumMisses(0)
+{
+	// number of systems handled together, a multiple of the SIMD width
+	mNumLanes = max(4, min(64, kTileSize / mNumPairs / 4 * 4));
+
+	mFactor = &BatchLLT::factor<Dynamic, Dynamic>;
+	mSubstitute = &BatchLLT::substitute<Dynamic, Dynamic>;
+
+	// use kernels with compile-time sizes where available
+	switch(mDim) {
+		#define BATCHLLT_DIM(D) \
+			case D: \
+				mFactor = &BatchLLT::factor<D, Lanes<D>::value>; \
+				mSubstitute = &BatchLLT::substitute<D, Lanes<D>::value>; \
+				break;
+		BATCHLLT_FIXED_DIMS
+		#undef BATCHLLT_DIM
+	}
+
+	if(static_cast<long>(mNumPairs) * basis.cols() <= kMaxPairProducts) {
+		// products of rows turn the computation of all matrices into a single product
+		mPairProducts.resize(basis.cols(), mNumPairs);
+
+		for(int i = 0, k = 0; i < mDim; ++i)
+			for(int j = 0; j <= i; ++j, ++k)
+				mPairProducts.col(k) = basis.row(i).cwiseProduct(basis.row(j)).transpose();
+	}
+}
+
+
+
+void BatchLLT::solve(const MatrixXr& variances, const MatrixXr& inputs, MatrixXr& outputs) {
+	solve(variances, inputs, 0, outputs);
+}
+
+
+
+// computes x_j = L_j^{-T} (L_j^{-1} r_j + e_j), where L_j L_j^T = A diag(v_j) A^T; if the
+// e_j are standard normal, x_j is normal with mean (L_j L_j^T)^{-1} r_j and covariance
+// (L_j L_j^T)^{-1}
+void BatchLLT::sample(
+	const MatrixXr& variances,
+	const MatrixXr& inputs,
+	const MatrixXr& noise,
+	MatrixXr& outputs)
+{
+	solve(variances, inputs, &noise, outputs);
+}
+
+
+
+void BatchLLT::solve(
+	const MatrixXr& variances,
+	const MatrixXr& inputs,
+	const MatrixXr* noise,
+	MatrixXr& outputs)
+{
+	if(mCacheSize > 0) {
+		solveCached(variances, inputs, noise, outputs);
+		return;
+	}
+
+	int numTiles = (inputs.cols() + mNumLanes - 1) / mNumLanes;
+	int numLanes = mNumLanes;
+
+	outputs.resize(inputs.rows(), inputs.cols());
+
+	// the number of threads may have changed since construction, so workspaces are added
+	// here and the team is limited to the number of workspaces
+	#ifdef _OPENMP
+	int numThreads = omp_get_max_threads();
+	#else
+	int numThreads = 1;
+	#endif
+
+	if(static_cast<int>(mWorkspaces.size()) < numThreads)
+		mWorkspaces.resize(numThreads);
+
+	#pragma omp parallel num_threads(numThreads)
+	{
+		#ifdef _OPENMP
+		VectorXr& workspace = mWorkspaces[omp_get_thread_num()];
+		#else
+		VectorXr& workspace = mWorkspaces[0];
+		#endif
+
+		// memory is only allocated the first time a thread uses its workspace
+		workspace.resize((mNumPairs + 3 * mDim + mBasis.cols()) * numLanes);
+
+		real_t* factors = workspace.data();
+		real_t* invDiag = factors + mNumPairs * numLanes;
+		real_t* vectors = invDiag + mDim * numLanes;
+		real_t* noiseVectors = vectors + mDim * numLanes;
+		real_t* vars = noiseVectors + mDim * numLanes;
+
+		#pragma omp for
+		for(int t = 0; t < numTiles; ++t) {
+			int offset = t * numLanes;
+			int numCols = min(numLanes, static_cast<int>(inputs.cols()) - offset);
+
+			(this->*mFactor)(variances, offset, numCols, factors, invDiag, vars);
+
+			// interleave right-hand sides
+			for(int p = 0; p < numCols; ++p)
+				for(int i = 0; i < mDim; ++i)
+					vectors[i * numLanes + p] = inputs(i, offset + p);
+			for(int p = numCols; p < numLanes; ++p)
+				for(int i = 0; i < mDim; ++i)
+					vectors[i * numLanes + p] = 0.;
+
+			if(noise) {
+				for(int p = 0; p < numCols; ++p)
+					for(int i = 0; i < mDim; ++i)
+						noiseVectors[i * numLanes + p] = (*noise)(i, offset + p);
+				for(int p = numCols; p < numLanes; ++p)
+					for(int i = 0; i < mDim; ++i)
+						noiseVectors[i * numLanes + p] = 0.;
+			}
+
+			(this->*mSubstitute)(factors, invDiag, noise ? noiseVectors : 0, vectors);
+
+			for(int p = 0; p < numCols; ++p)
+				for(int i = 0; i < mDim; ++i)
+					outputs(i, offset + p) = vectors[i * numLanes + p];
+		}
+	}
+}
+
+
+
+void BatchLLT::solveCached(
+	const MatrixXr& variances,
+	const MatrixXr& inputs,
+	const MatrixXr* noise,
+	MatrixXr& outputs)
+{
+	vector<size_t> hashes(inputs.cols());
+
+	#pragma omp parallel for
+	for(int j = 0; j < inputs.cols(); ++j)
+		hashes[j] = hashColumn(variances, j);
+
+	// group data points by their variances
+	vector<vector<int> > groups;
+	multimap<size_t, int> groupIndex;
+
+	for(int j = 0; j < inputs.cols(); ++j) {
+		pair<multimap<size_t, int>::iterator, multimap<size_t, int>::iterator> range =
+			groupIndex.equal_range(hashes[j]);
+
+		multimap<size_t, int>::iterator it;
+		for(it = range.first; it != range.second; ++it)
+			if(variances.col(groups[it->second][0]) == variances.col(j))
+				break;
+
+		if(it == range.second) {
+			groupIndex.insert(make_pair(hashes[j], static_cast<int>(groups.size())));
+			groups.push_back(vector<int>(1, j));
+		} else {
+			groups[it->second].push_back(j);
+		}
+	}
+
+	// look up factors, creating empty entries for missing ones
+	vector<Cache::iterator> entries(groups.size());
+	vector<int> missing;
+
+	for(unsigned int g = 0; g < groups.size(); ++g) {
+		entries[g] = lookup(variances, groups[g][0], hashes[groups[g][0]]);
+
+		if(entries[g]->variances.size()) {
+			mNumHits += groups[g].size();
+		} else {
+			entries[g]->variances = variances.col(groups[g][0]);
+			missing.push_back(g);
+			mNumHits += groups[g].size() - 1;
+			mNumMisses += 1;
+		}
+	}
+
+	// compute missing factors
+	#pragma omp parallel for
+	for(int i = 0; i < static_cast<int>(missing.size()); ++i) {
+		CacheEntry& entry = *entries[missing[i]];
+
+		MatrixXr scaledBasis = mBasis * entry.variances.cwiseSqrt().asDiagonal();
+		MatrixXr matrix = MatrixXr::Zero(mDim, mDim);
+		matrix.selfadjointView<Lower>().rankUpdate(scaledBasis);
+
+		entry.factor.compute(matrix);
+	}
+
+	outputs.resize(inputs.rows(), inputs.cols());
+
+	// solve all systems of a group at once
+	#pragma omp parallel for schedule(dynamic)
+	for(int g = 0; g < static_cast<int>(groups.size()); ++g) {
+		const vector<int>& group = groups[g];
+		const LLT<MatrixXr>& factor = entries[g]->factor;
+
+		MatrixXr vectors(mDim, group.size());
+		for(unsigned int k = 0; k < group.size(); ++k)
+			vectors.col(k) = inputs.col(group[k]);
+
+		factor.matrixL().solveInPlace(vectors);
+
+		if(noise)
+			for(unsigned int k = 0; k < group.size(); ++k)
+				vectors.col(k) += noise->col(group[k]);
+
+		factor.matrixU().solveInPlace(vectors);
+
+		for(unsigned int k = 0; k < group.size(); ++k)
+			outputs.col(group[k]) = vectors.col(k);
+	}
+
+	// remove least recently used factors
+	while(static_cast<int>(mCache.size()) > mCacheSize) {
+		pair<multimap<size_t, Cache::iterator>::iterator, multimap<size_t, Cache::iterator>::iterator> range =
+			mCacheIndex.equal_range(mCache.back().hash);
+
+		for(multimap<size_t, Cache::iterator>::iterator it = range.first; it != range.second; ++it)
+			if(it->second == --mCache.end()) {
+				mCacheIndex.erase(it);
+				break;
+			}
+
+		mCache.pop_back();
+	}
+}
+
+
+
+BatchLLT::Cache::iterator BatchLLT::lookup(const MatrixXr& variances, int col, size_t hash) {
+	pair<multimap<size_t, Cache::iterator>::iterator, multimap<size_t, Cache::iterator>::iterator> range =
+		mCacheIndex.equal_range(hash);
+
+	for(multimap<size_t, Cache::iterator>::iterator it = range.first; it != range.second; ++it)
+		if(it->second->variances == variances.col(col)) {
+			// mark entry as most recently used
+			mCache.splice(mCache.begin(), mCache, it->second);
+			return it->second;
+		}
+
+	mCache.push_front(CacheEntry());
+	mCache.front().hash = hash;
+	mCacheIndex.insert(make_pair(hash, mCache.begin()));
+
+	return mCache.begin();
+}
+
+
+
+template <int Dim, int NumLanes>
+void BatchLLT::factor(
+	const MatrixXr& variances,
+	int offset,
+	int numCols,
+	real_t* factors,
+	real_t* invDiag,
+	real_t* vars)
+{
+	const int L = NumLanes == Dynamic ? mNumLanes : NumLanes;
+	const int D = Dim == Dynamic ? mDim : Dim;
+	const int numPairs = D * (D + 1) / 2;
+
+	// lower triangular parts of A diag(v) A^T, stored row by row and interleaved
+	if(mPairProducts.size()) {
+		// interleave variances
+		for(int h = 0; h < mPairProducts.rows(); ++h) {
+			for(int p = 0; p < numCols; ++p)
+				vars[h * L + p] = variances(h, offset + p);
+			for(int p = numCols; p < L; ++p)
+				vars[h * L + p] = 0.;
+		}
+
+		// interleaved matrices are the product of interleaved variances and pair products
+		Map<Matrix<real_t, NumLanes, Dynamic> >(factors, L, numPairs).noalias() =
+			Map<Matrix<real_t, NumLanes, Dynamic> >(vars, L, mPairProducts.rows()) * mPairProducts;
+	} else {
+		MatrixXr scaledBasis;
+		MatrixXr matrix(D, D);
+
+		for(int p = 0; p < numCols; ++p) {
+			scaledBasis = mBasis * variances.col(offset + p).cwiseSqrt().asDiagonal();
+			matrix.setZero();
+			matrix.selfadjointView<Lower>().rankUpdate(scaledBasis);
+
+			for(int i = 0, k = 0; i < D; ++i)
+				for(int j = 0; j <= i; ++j, ++k)
+					factors[k * L + p] = matrix(i, j);
+		}
+	}
+
+	// unused lanes are filled with identity matrices
+	for(int p = numCols; p < L; ++p)
+		for(int i = 0, k = 0; i < D; ++i)
+			for(int j = 0; j <= i; ++j, ++k)
+				factors[k * L + p] = i == j ? 1. : 0.;
+
+	// Cholesky decomposition, vectorized across lanes
+	for(int j = 0; j < D; ++j) {
+		real_t* Lj = factors + j * (j + 1) / 2 * L;
+		real_t* Ljj = Lj + j * L;
+		real_t* Dj = invDiag + j * L;
+
+		for(int k = 0; k < j; ++k) {
+			const real_t* Ljk = Lj + k * L;
+			for(int p = 0; p < L; ++p)
+				Ljj[p] -= Ljk[p] * Ljk[p];
+		}
+
+		for(int p = 0; p < L; ++p) {
+			Ljj[p] = sqrt(Ljj[p]);
+			Dj[p] = 1. / Ljj[p];
+		}
+
+		for(int i = j + 1; i < D; ++i) {
+			real_t* Li = factors + i * (i + 1) / 2 * L;
+			real_t* Lij = Li + j * L;
+
+			for(int k = 0; k < j; ++k) {
+				const real_t* Lik = Li + k * L;
+				const real_t* Ljk = Lj + k * L;
+				for(int p = 0; p < L; ++p)
+					Lij[p] -= Lik[p] * Ljk[p];
+			}
+
+			for(int p = 0; p < L; ++p)
+				Lij[p] *= Dj[p];
+		}
+	}
+}
+
+
+
+template <int Dim, int NumLanes>
+void BatchLLT::substitute(
+	const real_t* factors,
+	const real_t* invDiag,
+	const real_t* noise,
+	real_t* vectors)
+{
+	const int L = NumLanes == Dynamic ? mNumLanes : NumLanes;
+	const int D = Dim == Dynamic ? mDim : Dim;
+
+	// forward substitution
+	for(int i = 0; i < D; ++i) {
+		const real_t* Li = factors + i * (i + 1) / 2 * L;
+		real_t* yi = vectors + i * L;
+
+		for(int k = 0; k < i; ++k) {
+			const real_t* Lik = Li + k * L;
+			const real_t* yk = vectors + k * L;
+			for(int p = 0; p < L; ++p)
+				yi[p] -= Lik[p] * yk[p];
+		}
+
+		for(int p = 0; p < L; ++p)
+			yi[p] *= invDiag[i * L + p];
+	}
+
+	if(noise)
+		for(int k = 0; k < D * L; ++k)
+			vectors[k] += noise[k];
+
+	// backward substitution
+	for(int i = D - 1; i >= 0; --i) {
+		const real_t* Li = factors + i * (i + 1) / 2 * L;
+		real_t* xi = vectors + i * L;
+
+		for(int p = 0; p < L; ++p)
+			xi[p] *= invDiag[i * L + p];
+
+		for(int k = 0; k < i; ++k) {
+			const real_t* Lik = Li + k * L;
+			real_t* yk = vectors + k * L;
+			for(int p = 0; p < L; ++p)
+				yk[p] -= Lik[p] * xi[p];
+		}
+	}
+}
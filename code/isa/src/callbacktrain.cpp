@@ -1,9 +1,12 @@
 #include "callbacktrain.h"
+#include "pyutils.h"
 
 CallbackTrain::CallbackTrain(ISAObject* isa, PyObject* callback) : 
 	mIsa(isa), 
 	mCallback(callback) 
 {
+	EnsureGIL gil;
+
 	Py_INCREF(mIsa);
 	Py_INCREF(mCallback);
 }
@@ -14,6 +17,9 @@ CallbackTrain::CallbackTrain(const CallbackTrain& callbackTrain) :
 	mIsa(callbackTrain.mIsa),
 	mCallback(callbackTrain.mCallback)
 {
+	// parameters and their callbacks are also copied while the lock is released
+	EnsureGIL gil;
+
 	Py_INCREF(mIsa);
 	Py_INCREF(mCallback);
 }
@@ -21,6 +27,8 @@ CallbackTrain::CallbackTrain(const CallbackTrain& callbackTrain) :
 
 
 CallbackTrain::~CallbackTrain() {
+	EnsureGIL gil;
+
 	Py_DECREF(mIsa);
 	Py_DECREF(mCallback);
 }
@@ -28,6 +36,8 @@ CallbackTrain::~CallbackTrain() {
 
 
 CallbackTrain& CallbackTrain::operator=(const CallbackTrain& callbackTrain) {
+	EnsureGIL gil;
+
 	Py_DECREF(mIsa);
 	Py_DECREF(mCallback);
 
@@ -49,6 +59,9 @@ CallbackTrain* CallbackTrain::copy() {
 
 
 bool CallbackTrain::operator()(int iter, const ISA&) {
+	// training runs without the global interpreter lock
+	EnsureGIL gil;
+
 	// call Python object
 	PyObject* args = Py_BuildValue("(iO)", iter, mIsa);
 	PyObject* result = PyObject_CallObject(mCallback, args);
@@ -0,0 +1,382 @@
+#include "chainstore.h"
+#include "exception.h"
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::memcpy;
+using std::mutex;
+using std::lock_guard;
+using std::set;
+using std::pair;
+using std::make_pair;
+
+typedef pair<dev_t, ino_t> FileID;
+
+// files mapped by any store of this process; a file is only mapped by one store at a time,
+// since resizing it would invalidate the mappings of other stores
+static set<FileID> sMappedFiles;
+static mutex sMappedFilesMutex;
+
+static bool fileID(const string& filename, FileID& id) {
+	struct stat status;
+
+	if(stat(filename.c_str(), &status))
+		return false;
+
+	id = make_pair(status.st_dev, status.st_ino);
+	return true;
+}
+
+
+
+static void registerFile(int file) {
+	struct stat status;
+
+	if(fstat(file, &status))
+		return;
+
+	lock_guard<mutex> lock(sMappedFilesMutex);
+	sMappedFiles.insert(make_pair(status.st_dev, status.st_ino));
+}
+
+
+
+static void unregisterFile(int file) {
+	struct stat status;
+
+	if(fstat(file, &status))
+		return;
+
+	lock_guard<mutex> lock(sMappedFilesMutex);
+	sMappedFiles.erase(make_pair(status.st_dev, status.st_ino));
+}
+
+
+
+bool ChainStore::inUse(const string& filename) {
+	FileID id;
+
+	if(!fileID(filename, id))
+		return false;
+
+	lock_guard<mutex> lock(sMappedFilesMutex);
+	return sMappedFiles.count(id) > 0;
+}
+
+
+
+
+ChainStore::ChainStore() :
+	mRows(0),
+	mCols(0),
+	mFile(-1),
+	mMapping(0),
+	mMappingSize(0)
+{
+}
+
+
+
+ChainStore::ChainStore(const ChainStore& store) :
+	mRows(0),
+	mCols(0),
+	mFile(-1),
+	mMapping(0),
+	mMappingSize(0)
+{
+	*this = store;
+}
+
+
+
+ChainStore::~ChainStore() {
+	unmapFile();
+}
+
+
+
+ChainStore& ChainStore::operator=(const ChainStore& store) {
+	if(this == &store)
+		return *this;
+
+	// copies keep their states in memory, since writes to a shared file would affect
+	// both stores and resizing one store could invalidate the mapping of the other
+	unmapFile();
+	mMemory = store.matrix();
+	mRows = store.mRows;
+	mCols = store.mCols;
+
+	return *this;
+}
+
+
+
+ChainStore& ChainStore::operator=(const MatrixXr& states) {
+	resize(states.rows(), states.cols());
+	matrix() = states;
+	return *this;
+}
+
+
+
+ChainStore& ChainStore::operator=(MatrixXr&& states) {
+	if(mapped())
+		return *this = static_cast<const MatrixXr&>(states);
+
+	mMemory.swap(states);
+	mRows = mMemory.rows();
+	mCols = mMemory.cols();
+
+	return *this;
+}
+
+
+
+void ChainStore::resize(int rows, int cols) {
+	if(mapped()) {
+		mapFile(rows, cols);
+	} else {
+		mMemory.resize(rows, cols);
+		mRows = rows;
+		mCols = cols;
+	}
+}
+
+
+
+void ChainStore::map(const string& filename) {
+	if(mapped() && (filename == mFilename || mapsFile(filename)))
+		return;
+
+	// the file would be truncated under the mapping of another store
+	if(inUse(filename))
+		throw Exception("File for hidden states is already used by another model.");
+
+	int file = ::open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if(file < 0)
+		throw Exception("Could not open file for hidden states.");
+
+	size_t size = sizeof(real_t) * mRows * mCols;
+	real_t* mapping = 0;
+
+	if(ftruncate(file, size)) {
+		::close(file);
+		throw Exception("Could not allocate file for hidden states.");
+	}
+
+	if(size > 0) {
+		void* address = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+
+		if(address == MAP_FAILED) {
+			::close(file);
+			throw Exception("Could not map file for hidden states.");
+		}
+
+		mapping = static_cast<real_t*>(address);
+		memcpy(mapping, data(), size);
+	}
+
+	unmapFile();
+	mMemory.resize(0, 0);
+
+	mFilename = filename;
+	mFile = file;
+	mMapping = mapping;
+	mMappingSize = size;
+
+	registerFile(mFile);
+}
+
+
+
+void ChainStore::open(const string& filename, int rows) {
+	if(inUse(filename) && !mapsFile(filename))
+		throw Exception("File for hidden states is already used by another model.");
+
+	int file = ::open(filename.c_str(), O_RDWR);
+
+	if(file < 0)
+		throw Exception("Could not open file for hidden states.");
+
+	struct stat status;
+
+	if(fstat(file, &status) || rows <= 0 || status.st_size % (sizeof(real_t) * rows)) {
+		::close(file);
+		throw Exception("Size of file does not match number of hidden units.");
+	}
+
+	unmapFile();
+	mMemory.resize(0, 0);
+
+	mFilename = filename;
+	mFile = file;
+	mRows = 0;
+	mCols = 0;
+
+	registerFile(mFile);
+
+	mapFile(rows, status.st_size / (sizeof(real_t) * rows));
+}
+
+
+
+void ChainStore::load(const string& filename, int rows) {
+	int file = ::open(filename.c_str(), O_RDONLY);
+
+	if(file < 0)
+		throw Exception("Could not open file for hidden states.");
+
+	struct stat status;
+
+	if(fstat(file, &status) || rows <= 0 || status.st_size % (sizeof(real_t) * rows)) {
+		::close(file);
+		throw Exception("Size of file does not match number of hidden units.");
+	}
+
+	MatrixXr states(rows, status.st_size / (sizeof(real_t) * rows));
+	char* buffer = reinterpret_cast<char*>(states.data());
+	size_t size = status.st_size;
+
+	for(size_t offset = 0; offset < size;) {
+		ssize_t numBytes = pread(file, buffer + offset, size - offset, offset);
+
+		if(numBytes <= 0) {
+			::close(file);
+			throw Exception("Could not read file for hidden states.");
+		}
+
+		offset += numBytes;
+	}
+
+	::close(file);
+
+	unmapFile();
+
+	*this = std::move(states);
+}
+
+
+
+void ChainStore::unmap() {
+	if(!mapped())
+		return;
+
+	mMemory = matrix();
+
+	unmapFile();
+}
+
+
+
+Map<MatrixXr> ChainStore::matrix() {
+	return Map<MatrixXr>(data(), mRows, mCols);
+}
+
+
+
+Map<const MatrixXr> ChainStore::matrix() const {
+	return Map<const MatrixXr>(data(), mRows, mCols);
+}
+
+
+
+Map<MatrixXr> ChainStore::block(int offset, int numCols) {
+	if(offset < 0 || numCols < 0 || offset + numCols > mCols)
+		throw Exception("Invalid block of hidden states.");
+
+	return Map<MatrixXr>(data() + static_cast<size_t>(offset) * mRows, mRows, numCols);
+}
+
+
+
+void ChainStore::prefetch(int offset, int numCols) const {
+	if(!mapped() || offset < 0 || offset >= mCols || numCols <= 0)
+		return;
+
+	if(offset + numCols > mCols)
+		numCols = mCols - offset;
+
+	// madvise expects addresses aligned to pages
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t begin = sizeof(real_t) * mRows * static_cast<size_t>(offset);
+	size_t end = begin + sizeof(real_t) * mRows * static_cast<size_t>(numCols);
+	begin -= begin % pageSize;
+
+	madvise(reinterpret_cast<char*>(mMapping) + begin, end - begin, MADV_WILLNEED);
+}
+
+
+
+void ChainStore::mapFile(int rows, int cols) {
+	size_t size = sizeof(real_t) * rows * static_cast<size_t>(cols);
+	real_t* mapping = 0;
+
+	// the previous mapping remains valid if the file could not be resized
+	if(ftruncate(mFile, size))
+		throw Exception("Could not allocate file for hidden states.");
+
+	if(size > 0) {
+		void* address = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, mFile, 0);
+
+		if(address == MAP_FAILED) {
+			// the previous mapping may reach beyond the end of the resized file
+			if(mMapping)
+				munmap(mMapping, mMappingSize);
+
+			mRows = 0;
+			mCols = 0;
+			mMapping = 0;
+			mMappingSize = 0;
+
+			throw Exception("Could not map file for hidden states.");
+		}
+
+		mapping = static_cast<real_t*>(address);
+
+		// chains are visited in order, so pages can be read ahead and dropped early
+		madvise(mapping, size, MADV_SEQUENTIAL);
+	}
+
+	if(mMapping)
+		munmap(mMapping, mMappingSize);
+
+	mRows = rows;
+	mCols = cols;
+	mMapping = mapping;
+	mMappingSize = size;
+}
+
+
+
+void ChainStore::unmapFile() {
+	if(mMapping)
+		munmap(mMapping, mMappingSize);
+	if(mFile >= 0) {
+		unregisterFile(mFile);
+		::close(mFile);
+	}
+
+	mFilename = "";
+	mFile = -1;
+	mMapping = 0;
+	mMappingSize = 0;
+}
+
+
+
+bool ChainStore::mapsFile(const string& filename) const {
+	FileID id;
+	struct stat status;
+
+	if(!mapped() || !fileID(filename, id) || fstat(mFile, &status))
+		return false;
+
+	return id == make_pair(status.st_dev, status.st_ino);
+}
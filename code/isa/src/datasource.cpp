@@ -0,0 +1,354 @@
+#include "datasource.h"
+#include "exception.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using std::ifstream;
+using std::strtol;
+
+// copies a block of columns from strided memory
+template <class Scalar>
+static void copyBlock(const char* data, long rowStride, long colStride, MatrixXr& block) {
+	if(rowStride <= colStride) {
+		#pragma omp parallel for if(block.size() > 100000)
+		for(int j = 0; j < block.cols(); ++j)
+			for(int i = 0; i < block.rows(); ++i)
+				block(i, j) = *reinterpret_cast<const Scalar*>(data + j * colStride + i * rowStride);
+	} else {
+		// visit memory in the order in which it is stored
+		#pragma omp parallel for if(block.size() > 100000)
+		for(int i = 0; i < block.rows(); ++i)
+			for(int j = 0; j < block.cols(); ++j)
+				block(i, j) = *reinterpret_cast<const Scalar*>(data + j * colStride + i * rowStride);
+	}
+}
+
+
+
+// extracts the value of an entry of the dictionary stored in the header of a .npy file
+static string npyHeaderEntry(const string& header, const string& key) {
+	size_t begin = header.find("'" + key + "'");
+
+	if(begin == string::npos)
+		throw Exception("Invalid header in .npy file.");
+
+	begin = header.find(':', begin) + 1;
+	while(begin < header.size() && header[begin] == ' ')
+		++begin;
+
+	// values are either strings, tuples or literals
+	size_t end;
+	if(header[begin] == '\'')
+		end = header.find('\'', begin + 1) + 1;
+	else if(header[begin] == '(')
+		end = header.find(')', begin) + 1;
+	else
+		end = header.find(',', begin);
+
+	if(end == string::npos || end == 0)
+		throw Exception("Invalid header in .npy file.");
+
+	return header.substr(begin, end - begin);
+}
+
+
+
+DataSource::~DataSource() {
+}
+
+
+
+void DataSource::prefetch(int, int) const {
+}
+
+
+
+const MatrixXr* DataSource::matrix() const {
+	return 0;
+}
+
+
+
+const MatrixXr& DataSource::fetch(int offset, int numCols, MatrixXr& buffer) const {
+	if(offset == 0 && numCols == cols() && matrix())
+		return *matrix();
+
+	buffer = block(offset, numCols);
+
+	return buffer;
+}
+
+
+
+MatrixSource::MatrixSource(const MatrixXr& data) : mData(data) {
+}
+
+
+
+int MatrixSource::rows() const {
+	return mData.rows();
+}
+
+
+
+int MatrixSource::cols() const {
+	return mData.cols();
+}
+
+
+
+MatrixXr MatrixSource::block(int offset, int numCols) const {
+	if(offset < 0 || numCols < 0 || offset + numCols > mData.cols())
+		throw Exception("Invalid block of data points.");
+
+	return mData.middleCols(offset, numCols);
+}
+
+
+
+const MatrixXr* MatrixSource::matrix() const {
+	return &mData;
+}
+
+
+
+ArraySource::ArraySource(
+	const void* data,
+	int rows,
+	int cols,
+	long rowStride,
+	long colStride,
+	bool singlePrecision) :
+	mData(static_cast<const char*>(data)),
+	mRows(rows),
+	mCols(cols),
+	mRowStride(rowStride),
+	mColStride(colStride),
+	mSinglePrecision(singlePrecision)
+{
+}
+
+
+
+ArraySource::ArraySource() :
+	mData(0),
+	mRows(0),
+	mCols(0),
+	mRowStride(0),
+	mColStride(0),
+	mSinglePrecision(false)
+{
+}
+
+
+
+int ArraySource::rows() const {
+	return mRows;
+}
+
+
+
+int ArraySource::cols() const {
+	return mCols;
+}
+
+
+
+MatrixXr ArraySource::block(int offset, int numCols) const {
+	if(offset < 0 || numCols < 0 || offset + numCols > mCols)
+		throw Exception("Invalid block of data points.");
+
+	MatrixXr block(mRows, numCols);
+
+	if(mSinglePrecision)
+		copyBlock<float>(mData + offset * mColStride, mRowStride, mColStride, block);
+	else
+		copyBlock<double>(mData + offset * mColStride, mRowStride, mColStride, block);
+
+	return block;
+}
+
+
+
+void ArraySource::prefetch(int offset, int numCols) const {
+	if(offset < 0 || offset >= mCols || numCols <= 0)
+		return;
+
+	// blocks of row-major arrays are spread over the whole array
+	if(mRowStride > mColStride)
+		return;
+
+	if(offset + numCols > mCols)
+		numCols = mCols - offset;
+
+	// madvise expects addresses aligned to pages
+	size_t pageSize = sysconf(_SC_PAGESIZE);
+	size_t begin = reinterpret_cast<size_t>(mData + offset * mColStride);
+	size_t end = reinterpret_cast<size_t>(mData + (offset + numCols) * mColStride);
+	begin -= begin % pageSize;
+
+	madvise(reinterpret_cast<void*>(begin), end - begin, MADV_WILLNEED);
+}
+
+
+
+RawSource::RawSource(const string& filename, int rows, bool singlePrecision) :
+	mMapping(0),
+	mMappingSize(0)
+{
+	if(rows <= 0)
+		throw Exception("Number of rows should be positive.");
+
+	map(filename, 0);
+
+	size_t colSize = rows * (singlePrecision ? sizeof(float) : sizeof(double));
+
+	if(mMappingSize % colSize) {
+		munmap(mMapping, mMappingSize);
+		throw Exception("Size of file does not match number of rows.");
+	}
+
+	mRows = rows;
+	mCols = mMappingSize / colSize;
+	mRowStride = singlePrecision ? sizeof(float) : sizeof(double);
+	mColStride = colSize;
+	mSinglePrecision = singlePrecision;
+}
+
+
+
+RawSource::RawSource() : mMapping(0), mMappingSize(0) {
+}
+
+
+
+RawSource::~RawSource() {
+	if(mMapping)
+		munmap(mMapping, mMappingSize);
+}
+
+
+
+void RawSource::map(const string& filename, size_t offset) {
+	int file = ::open(filename.c_str(), O_RDONLY);
+
+	if(file < 0)
+		throw Exception("Could not open data file.");
+
+	struct stat status;
+
+	if(fstat(file, &status) || static_cast<size_t>(status.st_size) <= offset) {
+		::close(file);
+		throw Exception("Data file is empty.");
+	}
+
+	void* address = mmap(0, status.st_size, PROT_READ, MAP_SHARED, file, 0);
+
+	// the mapping stays valid after the file is closed
+	::close(file);
+
+	if(address == MAP_FAILED)
+		throw Exception("Could not map data file.");
+
+	mMapping = address;
+	mMappingSize = status.st_size;
+	mData = static_cast<const char*>(address) + offset;
+
+	// blocks of data points are usually visited in order
+	madvise(mMapping, mMappingSize, MADV_SEQUENTIAL);
+}
+
+
+
+NpySource::NpySource(const string& filename) {
+	ifstream file(filename.c_str(), ifstream::binary);
+
+	if(!file)
+		throw Exception("Could not open data file.");
+
+	// magic string and format version
+	unsigned char preamble[12];
+	file.read(reinterpret_cast<char*>(preamble), 10);
+
+	if(!file || std::memcmp(preamble, "\x93NUMPY", 6))
+		throw Exception("Data file is not in .npy format.");
+
+	size_t headerOffset;
+	size_t headerSize;
+
+	if(preamble[6] == 1) {
+		headerOffset = 10;
+		headerSize = preamble[8] | preamble[9] << 8;
+	} else {
+		file.read(reinterpret_cast<char*>(preamble) + 10, 2);
+		headerOffset = 12;
+		headerSize = preamble[8] | preamble[9] << 8 | preamble[10] << 16 | preamble[11] << 24;
+	}
+
+	string header(headerSize, ' ');
+	file.read(&header[0], headerSize);
+
+	if(!file)
+		throw Exception("Invalid header in .npy file.");
+
+	file.close();
+
+	string descr = npyHeaderEntry(header, "descr");
+	bool fortranOrder = npyHeaderEntry(header, "fortran_order") == "True";
+	string shape = npyHeaderEntry(header, "shape");
+
+	// values are expected to be stored in the byte order of the machine
+	if(descr == "'<f8'" || descr == "'=f8'")
+		mSinglePrecision = false;
+	else if(descr == "'<f4'" || descr == "'=f4'")
+		mSinglePrecision = true;
+	else
+		throw Exception("Data in .npy file should be stored as little-endian float32 or float64.");
+
+	// parse dimensions
+	const char* dims = shape.c_str() + 1;
+	char* end;
+	long rows = strtol(dims, &end, 10);
+	long cols = 1;
+
+	if(end == dims)
+		throw Exception("Data in .npy file should be one- or two-dimensional.");
+
+	while(*end == ',' || *end == ' ')
+		++end;
+
+	if(*end != ')') {
+		dims = end;
+		cols = strtol(dims, &end, 10);
+
+		while(*end == ',' || *end == ' ')
+			++end;
+
+		if(end == dims || *end != ')')
+			throw Exception("Data in .npy file should be one- or two-dimensional.");
+	}
+
+	mRows = rows;
+	mCols = cols;
+
+	long elementSize = mSinglePrecision ? sizeof(float) : sizeof(double);
+
+	if(fortranOrder) {
+		mRowStride = elementSize;
+		mColStride = elementSize * rows;
+	} else {
+		mRowStride = elementSize * cols;
+		mColStride = elementSize;
+	}
+
+	map(filename, headerOffset + headerSize);
+
+	// the mapping is released by the destructor of the base class
+	if(mMappingSize - headerOffset - headerSize < static_cast<size_t>(rows * cols * elementSize))
+		throw Exception("Data file is shorter than its header suggests.");
+}
@@ -8,6 +8,6 @@ Distribution::~Distribution() {
 
 
 
-double Distribution::evaluate(const MatrixXd& data) {
-	return -logLikelihood(data).mean() / log(2.) / dim();
+double Distribution::evaluate(const MatrixXr& data) {
+	return -logLikelihood(data).cast<double>().mean() / log(2.) / dim();
 }
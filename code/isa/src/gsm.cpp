@@ -1,89 +1,324 @@
 #include "gsm.h"
 #include "utils.h"
+#include "vecmath.h"
+#include "memorypool.h"
 #include <iostream>
 #include <cmath>
-#include <cstdlib>
+#include <algorithm>
+#include <vector>
 
 using std::log;
-using std::rand;
+using std::exp;
+using std::pow;
+using std::min;
+using std::max;
+using std::vector;
+
+// kernels are only parallelized if there are more data points than this
+static const int kMinParallelData = 1000;
+
+// number of data points whose sufficient statistics are accumulated together during EM
+static const int kChunkSize = 4096;
+
+// number of data points whose exponentials and logarithms are computed together
+static const int kBlockSize = 256;
+
+// limits on the number of nodes of energy tables
+static const int kMinTableSize = 64;
+static const int kMaxTableSize = 1 << 16;
+
+// energy, its slope and its curvature as functions of the squared norm
+static void exactEnergy(
+	const ArrayXd& logWeights,
+	const ArrayXd& precisions,
+	double sqNorm,
+	double& energy,
+	double& slope,
+	double& curvature)
+{
+	ArrayXd logJoint = logWeights - sqNorm / 2. * precisions;
+	double maxLogJoint = logJoint.maxCoeff();
+	ArrayXd post = (logJoint - maxLogJoint).exp();
+	double sum = post.sum();
+
+	post /= sum;
+
+	double meanPrecision = (post * precisions).sum();
+
+	energy = -maxLogJoint - log(sum);
+	slope = meanPrecision / 2.;
+	curvature = -((post * precisions.square()).sum() - meanPrecision * meanPrecision) / 4.;
+}
+
+// builds an alias table for sampling indices with the given probabilities (Vose's method);
+// an index k drawn uniformly is kept with probability threshold[k], otherwise replaced by alias[k]
+static void buildAliasTable(const ArrayXr& probs, ArrayXd& threshold, ArrayXi& alias) {
+	int size = probs.size();
+
+	ArrayXd scaled = probs.cast<double>() * (size / probs.cast<double>().sum());
 
-GSM::GSM(int dim, int numScales) : mDim(dim), mNumScales(numScales) {
-	mPriors = ArrayXd::Ones(mNumScales) / mNumScales;
-	mScales = 1. + ArrayXd::Random(mNumScales) / 4.;
+	threshold = ArrayXd::Ones(size);
+	alias.resize(size);
+
+	vector<int> small;
+	vector<int> large;
+
+	for(int k = 0; k < size; ++k) {
+		alias[k] = k;
+		if(scaled[k] < 1.)
+			small.push_back(k);
+		else
+			large.push_back(k);
+	}
+
+	while(!small.empty() && !large.empty()) {
+		int s = small.back();
+		int l = large.back();
+		small.pop_back();
+		large.pop_back();
+
+		threshold[s] = scaled[s];
+		alias[s] = l;
+
+		// move the excess probability mass of the large entry into the small entry
+		scaled[l] -= 1. - scaled[s];
+
+		if(scaled[l] < 1.)
+			small.push_back(l);
+		else
+			large.push_back(l);
+	}
+}
+
+
+
+GSM::GSM(int dim, int numScales) :
+	mDim(dim),
+	mNumScales(numScales),
+	mNumSteps(0),
+	mTableTol(0.),
+	mTableStep(0.)
+{
+	mPriors = ArrayXr::Ones(mNumScales) / mNumScales;
+	mScales = 1. + ArrayXr::Random(mNumScales) / 4.;
 	mScales /= mScales.mean();
 }
 
 
 
-bool GSM::train(const MatrixXd& data, int maxIter, double tol) {
+bool GSM::train(const MatrixXr& data, int maxIter, double tol) {
 	if(data.rows() != mDim)
 		throw Exception("Data has wrong dimensionality.");
 
-	RowVectorXd sqNorms = data.colwise().squaredNorm();
+	return trainNorms(data.colwise().squaredNorm(), maxIter, tol);
+}
+
 
-	double logLik = logLikelihood(data, sqNorms).mean();
 
-	for(int i = 0; i < maxIter; ++i) {
-		// compute unnormalized posterior over mixture components (E)
-		ArrayXXd post = posterior(data, sqNorms);
+bool GSM::trainNorms(const RowVectorXr& sqNorms, int maxIter, double tol) {
+	ArrayXd postMean;
+	ArrayXd postNormMean;
+	double logLik = 0.;
 
-		// update parameters (M)
-		mPriors = post.rowwise().mean() + 1e-6;
-		mPriors /= mPriors.sum();
-		mScales = (((post.rowwise() * sqNorms.array()).rowwise().mean() + 1e-9)
-			/ (mDim * post.rowwise().mean() + 3e-9)).sqrt();
+	// temporaries of one iteration reuse the memory of the previous iteration
+	MemoryPool::Scope scope;
 
-		if(tol > 0. && i % 5 == 0) {
-			double logLikNew = logLikelihood(data, sqNorms).mean();
+	for(int i = 0; i < maxIter; ++i) {
+		// average posterior and posterior-weighted squared norm (E)
+		double logLikNew = computeStatistics(sqNorms, postMean, postNormMean);
 
+		// the E-step evaluates the parameters of the previous M-step
+		if(tol > 0. && i > 0 && (i - 1) % 5 == 0) {
 			// check for convergence
-			if(logLikNew - logLik < tol)
+			if(logLikNew - logLik < tol) {
+				updateEnergyTable();
 				return true;
+			}
 
+			logLik = logLikNew;
+		} else if(i == 0) {
 			logLik = logLikNew;
 		}
+
+		// update parameters (M)
+		updateParameters(postMean, postNormMean);
 	}
 
+	updateEnergyTable();
+
 	return false;
 }
 
 
 
-MatrixXd GSM::sample(int numSamples) {
-	Array<double, 1, Dynamic> scales(1, numSamples);
+void GSM::trainOnline(const MatrixXr& data, int maxIter, int batchSize, double stepWidth, double decay) {
+	if(data.rows() != mDim)
+		throw Exception("Data has wrong dimensionality.");
+	if(data.cols() < 1)
+		return;
+
+	int numData = data.cols();
+
+	if(batchSize <= 0 || batchSize > numData)
+		batchSize = numData;
+
+	RowVectorXr sqNorms;
+	ArrayXd postMean;
+	ArrayXd postNormMean;
+
+	MemoryPool::Scope scope;
+
+	for(int i = 0; i < maxIter; ++i, ++mNumSteps) {
+		if(batchSize < numData) {
+			// squared norms of randomly chosen data points
+			ArrayXXr urand = mRNG.uniform(1, batchSize);
+
+			sqNorms.resize(batchSize);
+			for(int j = 0; j < batchSize; ++j)
+				sqNorms[j] = data.col(min(static_cast<int>(urand(j) * numData), numData - 1)).squaredNorm();
+		} else if(i == 0) {
+			sqNorms = data.colwise().squaredNorm();
+		}
+
+		computeStatistics(sqNorms, postMean, postNormMean);
+
+		double rho = min(1., stepWidth * pow(1. + mNumSteps, -decay));
+
+		// statistics which would be reproduced by the current parameters
+		ArrayXd priors = mPriors.cast<double>();
+		ArrayXd variances = mScales.square().cast<double>();
+
+		updateParameters(
+			(1. - rho) * priors + rho * postMean,
+			(1. - rho) * mDim * priors * variances + rho * postNormMean);
+	}
+
+	updateEnergyTable();
+}
+
 
-	#pragma omp parallel for
-	for(int j = 0; j < numSamples; ++j) {
-		int i = 0;
-		double urand = static_cast<double>(rand()) / (static_cast<long>(RAND_MAX) + 1l);
 
-		// compute index
-		for(double cdf = mPriors[0]; cdf < urand; cdf += mPriors[i])
-			++i;
+MatrixXr GSM::sample(int numSamples) {
+	return sample(numSamples, mRNG);
+}
+
+
+
+MatrixXr GSM::sample(int numSamples, RNG& rng) {
+	Array<real_t, 1, Dynamic> scales(1, numSamples);
+	ArrayXXr urand = rng.uniform(1, numSamples);
+
+	ArrayXd threshold;
+	ArrayXi alias;
+
+	buildAliasTable(mPriors, threshold, alias);
 
-		scales[j] = mScales[i];
+	#pragma omp parallel for if(numSamples > kMinParallelData)
+	for(int j = 0; j < numSamples; ++j) {
+		// the integer part of the random number selects an entry, the rest decides between
+		// the entry and its alias
+		double u = urand(j) * mNumScales;
+		int k = min(static_cast<int>(u), mNumScales - 1);
+
+		scales[j] = mScales[u - k < threshold[k] ? k : alias[k]];
 	}
 
 	// scale normal samples
-	return sampleNormal(mDim, numSamples).rowwise() * scales;
+	return rng.normal(mDim, numSamples).rowwise() * scales;
+}
+
+
+
+Array<real_t, 1, Dynamic> GSM::samplePosterior(const MatrixXr& data) {
+	return samplePosterior(data, mRNG);
+}
+
+
+
+Array<real_t, 1, Dynamic> GSM::samplePosterior(const MatrixXr& data, RNG& rng) {
+	return samplePosteriorNorms(data.colwise().squaredNorm(), rng);
+}
+
+
+
+Array<real_t, 1, Dynamic> GSM::samplePosteriorNorms(const RowVectorXr& sqNorms, RNG& rng) {
+	switch(mNumScales) {
+		case 8:
+			return samplePosteriorKernel<8>(sqNorms, rng);
+		case 10:
+			return samplePosteriorKernel<10>(sqNorms, rng);
+		case 12:
+			return samplePosteriorKernel<12>(sqNorms, rng);
+		case 16:
+			return samplePosteriorKernel<16>(sqNorms, rng);
+		case 20:
+			return samplePosteriorKernel<20>(sqNorms, rng);
+		default:
+			return samplePosteriorKernel<Dynamic>(sqNorms, rng);
+	}
 }
 
 
 
-Array<double, 1, Dynamic> GSM::samplePosterior(const MatrixXd& data) {
-	Array<double, 1, Dynamic> scales(data.cols());
-	ArrayXXd post = posterior(data);
+template <int NumScales>
+Array<real_t, 1, Dynamic> GSM::samplePosteriorKernel(const RowVectorXr& sqNorms, RNG& rng) const {
+	const int numScales = NumScales == Dynamic ? mNumScales : NumScales;
+	int numData = sqNorms.size();
 
-	#pragma omp parallel for
-	for(int j = 0; j < post.cols(); ++j) {
-		int i = 0;
-		double urand = static_cast<double>(rand()) / (static_cast<long>(RAND_MAX) + 1l);
+	Array<real_t, 1, Dynamic> scales(numData);
 
-		// compute index
-		for(double cdf = post(0, j); cdf < urand; cdf += post(i, j))
-			++i;
+	// parts of the log-joint which do not depend on the data
+	Array<double, NumScales, 1> logWeights = (mPriors.log() - mDim * mScales.log()).cast<double>();
+	Array<double, NumScales, 1> precisions = mScales.square().inverse().cast<double>();
 
-		scales[j] = mScales[i];
+	// each block of random bits provides two uniform random numbers
+	int blocksPerData = (numScales + 1) / 2;
+	uint64_t counter = rng.reserve(static_cast<uint64_t>(numData) * blocksPerData);
+
+	int numBlocks = (numData + kBlockSize - 1) / kBlockSize;
+
+	#pragma omp parallel if(numData > kMinParallelData)
+	{
+		// perturbations of a block of data points, one row per scale
+		Matrix<double, NumScales, Dynamic> noise(numScales, kBlockSize);
+
+		#pragma omp for
+		for(int b = 0; b < numBlocks; ++b) {
+			int offset = b * kBlockSize;
+			int n = min(kBlockSize, numData - offset);
+			uint32_t bits[4];
+
+			for(int i = 0; i < n; ++i)
+				for(int k = 0; k < numScales; ++k) {
+					if(k % 2 == 0)
+						rng.generate(counter + static_cast<uint64_t>(offset + i) * blocksPerData + k / 2, 0, bits);
+					noise(k, i) = k % 2 ? RNG::toUniform(bits[2], bits[3]) : RNG::toUniform(bits[0], bits[1]);
+				}
+
+			// log(-log(u)) is the negative of a Gumbel distributed random variable
+			vlog(noise.data(), noise.data(), numScales * n);
+			noise.leftCols(n) = -noise.leftCols(n);
+			vlog(noise.data(), noise.data(), numScales * n);
+
+			for(int i = 0; i < n; ++i) {
+				double halfSqNorm = sqNorms[offset + i] / 2.;
+				double maxKey = 0.;
+				int index = 0;
+
+				// Gumbel-max trick, the index maximizing the perturbed log-joint is distributed
+				// according to the posterior, which therefore does not need to be normalized
+				for(int k = 0; k < numScales; ++k) {
+					double key = logWeights[k] - halfSqNorm * precisions[k] - noise(k, i);
+
+					if(k == 0 || key > maxKey) {
+						maxKey = key;
+						index = k;
+					}
+				}
+
+				scales[offset + i] = mScales[index];
+			}
+		}
 	}
 
 	return scales;
@@ -91,63 +326,415 @@ Array<double, 1, Dynamic> GSM::samplePosterior(const MatrixXd& data) {
 
 
 
-ArrayXXd GSM::posterior(const MatrixXd& data) {
+ArrayXXr GSM::posterior(const MatrixXr& data) {
 	return posterior(data, data.colwise().squaredNorm());
 }
 
 
 
-ArrayXXd GSM::posterior(const MatrixXd& data, const RowVectorXd& sqNorms) {
-	// compute unnormalized log-posterior
-	ArrayXXd posterior = logJoint(data, sqNorms);
+ArrayXXr GSM::posterior(const MatrixXr&, const RowVectorXr& sqNorms) {
+	Array<real_t, 1, Dynamic> energy;
+	ArrayXXr posterior;
 
-	// normalize posterior in a numerically stable way
-	posterior.rowwise() -= posterior.colwise().maxCoeff().eval();
-	posterior = posterior.exp();
-	posterior.rowwise() /= posterior.colwise().sum().eval();
+	computeEnergy(sqNorms, energy, 0, &posterior);
 
 	return posterior;
 }
 
 
 
-ArrayXXd GSM::logJoint(const MatrixXd& data) {
+ArrayXXr GSM::logJoint(const MatrixXr& data) {
 	return logJoint(data, data.colwise().squaredNorm());
 }
 
 
 
-ArrayXXd GSM::logJoint(const MatrixXd& data, const RowVectorXd& sqNorms) {
+ArrayXXr GSM::logJoint(const MatrixXr&, const RowVectorXr& sqNorms) {
 	return (-0.5 * mScales.square().inverse().matrix() * sqNorms).colwise()
 		+ (mPriors.log() - mDim * mScales.log()).matrix();
 }
 
 
 
-Array<double, 1, Dynamic> GSM::logLikelihood(const MatrixXd& data) {
+Array<real_t, 1, Dynamic> GSM::logLikelihood(const MatrixXr& data) {
 	return -energy(data).array() - mDim / 2. * log(2. * PI);
 }
 
 
 
-Array<double, 1, Dynamic> GSM::logLikelihood(const MatrixXd& data, const RowVectorXd& sqNorms) {
+Array<real_t, 1, Dynamic> GSM::logLikelihood(const MatrixXr& data, const RowVectorXr& sqNorms) {
 	return -energy(data, sqNorms).array() - mDim / 2. * log(2. * PI);
 }
 
 
 
-Array<double, 1, Dynamic> GSM::energy(const MatrixXd& data) {
-	return -logsumexp(logJoint(data));
+Array<real_t, 1, Dynamic> GSM::energy(const MatrixXr& data) {
+	return energy(data, data.colwise().squaredNorm());
+}
+
+
+
+Array<real_t, 1, Dynamic> GSM::energy(const MatrixXr&, const RowVectorXr& sqNorms) {
+	Array<real_t, 1, Dynamic> energy;
+
+	computeEnergy(sqNorms, energy);
+
+	return energy;
+}
+
+
+
+ArrayXXr GSM::energyGradient(const MatrixXr& data) {
+	Array<real_t, 1, Dynamic> energy;
+	Array<real_t, 1, Dynamic> gradientScales;
+
+	computeEnergy(data.colwise().squaredNorm(), energy, &gradientScales);
+
+	return data.array().rowwise() * gradientScales;
+}
+
+
+
+void GSM::computeEnergy(
+	const RowVectorXr& sqNorms,
+	Array<real_t, 1, Dynamic>& energy,
+	Array<real_t, 1, Dynamic>* gradientScales,
+	ArrayXXr* posterior) const
+{
+	switch(mNumScales) {
+		case 8:
+			return computeEnergyKernel<8>(sqNorms, energy, gradientScales, posterior);
+		case 10:
+			return computeEnergyKernel<10>(sqNorms, energy, gradientScales, posterior);
+		case 12:
+			return computeEnergyKernel<12>(sqNorms, energy, gradientScales, posterior);
+		case 16:
+			return computeEnergyKernel<16>(sqNorms, energy, gradientScales, posterior);
+		case 20:
+			return computeEnergyKernel<20>(sqNorms, energy, gradientScales, posterior);
+		default:
+			return computeEnergyKernel<Dynamic>(sqNorms, energy, gradientScales, posterior);
+	}
+}
+
+
+
+template <int NumScales>
+void GSM::computeEnergyKernel(
+	const RowVectorXr& sqNorms,
+	Array<real_t, 1, Dynamic>& energy,
+	Array<real_t, 1, Dynamic>* gradientScales,
+	ArrayXXr* posterior) const
+{
+	const int numScales = NumScales == Dynamic ? mNumScales : NumScales;
+	int numData = sqNorms.size();
+
+	energy.resize(numData);
+	if(gradientScales)
+		gradientScales->resize(numData);
+	if(posterior)
+		posterior->resize(numScales, numData);
+
+	// parts of the log-joint which do not depend on the data
+	Array<real_t, NumScales, 1> logWeights = mPriors.log() - mDim * mScales.log();
+	Array<real_t, NumScales, 1> precisions = mScales.square().inverse();
+
+	const real_t* w = logWeights.data();
+	const real_t* p = precisions.data();
+
+	// tables only cover squared norms below this value
+	int numNodes = mTableEnergy.size();
+	real_t maxSqNorm = (numNodes - 1) * mTableStep;
+
+	int numBlocks = (numData + kBlockSize - 1) / kBlockSize;
+
+	#pragma omp parallel for if(numData > kMinParallelData)
+	for(int b = 0; b < numBlocks; ++b) {
+		// data points of this block which are not covered by the table
+		int index[kBlockSize];
+		real_t halfSqNorm[kBlockSize];
+		int n = 0;
+
+		for(int j = b * kBlockSize; j < min((b + 1) * kBlockSize, numData); ++j) {
+			if(numNodes && !posterior && sqNorms[j] < maxSqNorm) {
+				// cubic Hermite interpolation between neighboring nodes
+				real_t u = sqNorms[j] / mTableStep;
+				int i = min(static_cast<int>(u), numNodes - 2);
+				real_t t = u - i;
+				real_t s = 1. - t;
+
+				real_t h00 = (1. + 2. * t) * s * s;
+				real_t h10 = t * s * s * mTableStep;
+				real_t h01 = t * t * (3. - 2. * t);
+				real_t h11 = -t * t * s * mTableStep;
+
+				energy[j] = h00 * mTableEnergy[i] + h10 * mTableSlope[i]
+					+ h01 * mTableEnergy[i + 1] + h11 * mTableSlope[i + 1];
+
+				if(gradientScales)
+					(*gradientScales)[j] = 2. * (h00 * mTableSlope[i] + h10 * mTableCurvature[i]
+						+ h01 * mTableSlope[i + 1] + h11 * mTableCurvature[i + 1]);
+			} else {
+				index[n] = j;
+				halfSqNorm[n] = sqNorms[j] / 2.;
+				++n;
+			}
+		}
+
+		if(!n)
+			continue;
+
+		real_t maxLogJoint[kBlockSize];
+		real_t joint[kBlockSize];
+		real_t sum[kBlockSize];
+		real_t weightedSum[kBlockSize];
+
+		for(int i = 0; i < n; ++i)
+			maxLogJoint[i] = w[0] - halfSqNorm[i] * p[0];
+		for(int k = 1; k < numScales; ++k)
+			for(int i = 0; i < n; ++i)
+				maxLogJoint[i] = max(maxLogJoint[i], w[k] - halfSqNorm[i] * p[k]);
+
+		for(int i = 0; i < n; ++i) {
+			sum[i] = 0.;
+			weightedSum[i] = 0.;
+		}
+
+		// log-sum-exp over scales, exponentials of all data points are computed at once
+		for(int k = 0; k < numScales; ++k) {
+			for(int i = 0; i < n; ++i)
+				joint[i] = w[k] - halfSqNorm[i] * p[k] - maxLogJoint[i];
+
+			vexp(joint, joint, n);
+
+			for(int i = 0; i < n; ++i) {
+				sum[i] += joint[i];
+				weightedSum[i] += joint[i] * p[k];
+			}
+		}
+
+		vlog(sum, joint, n);
+
+		for(int i = 0; i < n; ++i) {
+			// maximum is replaced by the logarithm of the normalization constant
+			maxLogJoint[i] += joint[i];
+
+			energy[index[i]] = -maxLogJoint[i];
+
+			if(gradientScales)
+				// posterior expectation of the precision
+				(*gradientScales)[index[i]] = weightedSum[i] / sum[i];
+		}
+
+		if(posterior)
+			for(int k = 0; k < numScales; ++k) {
+				for(int i = 0; i < n; ++i)
+					joint[i] = w[k] - halfSqNorm[i] * p[k] - maxLogJoint[i];
+
+				vexp(joint, joint, n);
+
+				for(int i = 0; i < n; ++i)
+					(*posterior)(k, index[i]) = joint[i];
+			}
+	}
+}
+
+
+
+void GSM::setEnergyTableTol(double tol) {
+	mTableTol = tol;
+	updateEnergyTable();
+}
+
+
+
+void GSM::updateEnergyTable() {
+	mTableEnergy.resize(0);
+	mTableSlope.resize(0);
+	mTableCurvature.resize(0);
+
+	if(mTableTol <= 0.)
+		return;
+
+	// squared norms are rarely larger than this, larger ones are handled exactly
+	double maxScale = mScales.maxCoeff();
+	real_t maxSqNorm = maxScale * maxScale * (mDim + 10. * sqrt(2. * mDim) + 20.);
+
+	ArrayXd logWeights = (mPriors.cast<double>().log() - mDim * mScales.cast<double>().log());
+	ArrayXd precisions = mScales.cast<double>().square().inverse();
+
+	for(int numNodes = kMinTableSize; numNodes <= kMaxTableSize; numNodes *= 2) {
+		tabulateEnergy(numNodes, maxSqNorm);
+
+		double maxError = 0.;
+		bool monotone = true;
+
+		// the interpolation error of cubic Hermite splines is usually largest halfway between
+		// nodes, so the error is only estimated there; this is a heuristic, not a bound
+		for(int i = 0; i + 1 < numNodes && maxError <= mTableTol && monotone; ++i) {
+			double energy, slope, curvature;
+			exactEnergy(logWeights, precisions, (i + 0.5) * mTableStep, energy, slope, curvature);
+
+			Array<real_t, 1, Dynamic> sqNorm(1);
+			Array<real_t, 1, Dynamic> energyApprox;
+			Array<real_t, 1, Dynamic> gradientScale;
+			sqNorm[0] = (i + 0.5) * mTableStep;
+			computeEnergy(sqNorm, energyApprox, &gradientScale);
+
+			maxError = std::max(maxError, std::abs(energyApprox[0] - energy));
+			maxError = std::max(maxError, std::abs(gradientScale[0] - 2. * slope));
+
+			// interpolant is monotone if slopes are not too large relative to the secant
+			double secant = (mTableEnergy[i + 1] - mTableEnergy[i]) / mTableStep;
+			double alpha = mTableSlope[i] / secant;
+			double beta = mTableSlope[i + 1] / secant;
+			monotone = secant > 0. && alpha * alpha + beta * beta <= 9.;
+		}
+
+		if(maxError <= mTableTol && monotone)
+			return;
+	}
+
+	// required precision cannot be reached, fall back to exact computation
+	mTableEnergy.resize(0);
+	mTableSlope.resize(0);
+	mTableCurvature.resize(0);
+}
+
+
+
+void GSM::tabulateEnergy(int numNodes, real_t maxSqNorm) {
+	ArrayXd logWeights = (mPriors.cast<double>().log() - mDim * mScales.cast<double>().log());
+	ArrayXd precisions = mScales.cast<double>().square().inverse();
+
+	mTableStep = maxSqNorm / (numNodes - 1);
+	mTableEnergy.resize(numNodes);
+	mTableSlope.resize(numNodes);
+	mTableCurvature.resize(numNodes);
+
+	for(int i = 0; i < numNodes; ++i) {
+		double energy, slope, curvature;
+		exactEnergy(logWeights, precisions, i * mTableStep, energy, slope, curvature);
+
+		mTableEnergy[i] = energy;
+		mTableSlope[i] = slope;
+		mTableCurvature[i] = curvature;
+	}
+}
+
+
+
+double GSM::computeStatistics(
+	const RowVectorXr& sqNorms,
+	ArrayXd& postMean,
+	ArrayXd& postNormMean) const
+{
+	switch(mNumScales) {
+		case 8:
+			return computeStatisticsKernel<8>(sqNorms, postMean, postNormMean);
+		case 10:
+			return computeStatisticsKernel<10>(sqNorms, postMean, postNormMean);
+		case 12:
+			return computeStatisticsKernel<12>(sqNorms, postMean, postNormMean);
+		case 16:
+			return computeStatisticsKernel<16>(sqNorms, postMean, postNormMean);
+		case 20:
+			return computeStatisticsKernel<20>(sqNorms, postMean, postNormMean);
+		default:
+			return computeStatisticsKernel<Dynamic>(sqNorms, postMean, postNormMean);
+	}
 }
 
 
 
-Array<double, 1, Dynamic> GSM::energy(const MatrixXd& data, const RowVectorXd& sqNorms) {
-	return -logsumexp(logJoint(data, sqNorms));
+template <int NumScales>
+double GSM::computeStatisticsKernel(
+	const RowVectorXr& sqNorms,
+	ArrayXd& postMean,
+	ArrayXd& postNormMean) const
+{
+	const int numScales = NumScales == Dynamic ? mNumScales : NumScales;
+	int numData = sqNorms.size();
+	int numChunks = (numData + kChunkSize - 1) / kChunkSize;
+
+	// statistics are accumulated per chunk and summed in a fixed order afterwards, so that
+	// results do not depend on the number of threads
+	ArrayXXd chunkPost = ArrayXXd::Zero(numScales, numChunks);
+	ArrayXXd chunkNorm = ArrayXXd::Zero(numScales, numChunks);
+	ArrayXd chunkLogLik = ArrayXd::Zero(numChunks);
+
+	// parts of the log-joint which do not depend on the data
+	Array<double, NumScales, 1> logWeights = (mPriors.log() - mDim * mScales.log()).cast<double>();
+	Array<double, NumScales, 1> precisions = mScales.square().inverse().cast<double>();
+
+	#pragma omp parallel for if(numData > kMinParallelData)
+	for(int c = 0; c < numChunks; ++c) {
+		// unnormalized posteriors of a block of data points, one column per scale
+		Matrix<double, Dynamic, NumScales> post(kBlockSize, numScales);
+
+		double halfSqNorm[kBlockSize];
+		double maxLogJoint[kBlockSize];
+		double sum[kBlockSize];
+		double logSum[kBlockSize];
+
+		double* postSum = &chunkPost(0, c);
+		double* normSum = &chunkNorm(0, c);
+		double logLikSum = 0.;
+
+		int end = min((c + 1) * kChunkSize, numData);
+
+		for(int offset = c * kChunkSize; offset < end; offset += kBlockSize) {
+			int n = min(kBlockSize, end - offset);
+
+			for(int i = 0; i < n; ++i) {
+				halfSqNorm[i] = sqNorms[offset + i] / 2.;
+				maxLogJoint[i] = logWeights[0] - halfSqNorm[i] * precisions[0];
+				sum[i] = 0.;
+			}
+
+			for(int k = 1; k < numScales; ++k)
+				for(int i = 0; i < n; ++i)
+					maxLogJoint[i] = max(maxLogJoint[i], logWeights[k] - halfSqNorm[i] * precisions[k]);
+
+			for(int k = 0; k < numScales; ++k) {
+				double* postk = &post(0, k);
+
+				for(int i = 0; i < n; ++i)
+					postk[i] = logWeights[k] - halfSqNorm[i] * precisions[k] - maxLogJoint[i];
+
+				vexp(postk, postk, n);
+
+				for(int i = 0; i < n; ++i)
+					sum[i] += postk[i];
+			}
+
+			vlog(sum, logSum, n);
+
+			for(int i = 0; i < n; ++i)
+				logLikSum += maxLogJoint[i] + logSum[i];
+
+			// statistics of each scale are accumulated in the order of the data points
+			for(int k = 0; k < numScales; ++k)
+				for(int i = 0; i < n; ++i) {
+					double p = post(i, k) / sum[i];
+					postSum[k] += p;
+					normSum[k] += p * sqNorms[offset + i];
+				}
+		}
+
+		chunkLogLik[c] = logLikSum;
+	}
+
+	postMean = chunkPost.rowwise().sum() / numData;
+	postNormMean = chunkNorm.rowwise().sum() / numData;
+
+	return chunkLogLik.sum() / numData - mDim / 2. * log(2. * PI);
 }
 
 
 
-ArrayXXd GSM::energyGradient(const MatrixXd& data) {
-	return data.array().rowwise() * (posterior(data).colwise() * mScales.square().inverse()).colwise().sum();
+void GSM::updateParameters(const ArrayXd& postMean, const ArrayXd& postNormMean) {
+	mPriors = (postMean + 1e-6).cast<real_t>();
+	mPriors /= mPriors.sum();
+	mScales = ((postNormMean + 1e-9) / (mDim * postMean + 3e-9)).sqrt().cast<real_t>();
 }
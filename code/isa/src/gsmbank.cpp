@@ -0,0 +1,176 @@
+#include "gsmbank.h"
+#include "exception.h"
+#include "vecmath.h"
+#include <algorithm>
+#include <cmath>
+
+using std::max;
+using std::min;
+
+// number of squared norms processed together by the energy kernel
+static const int kBlockSize = 4096;
+
+GSMBank::GSMBank(const vector<GSM>& subspaces) {
+	if(!compatible(subspaces))
+		throw Exception("All subspaces of a GSM bank should have the same shape.");
+
+	mDim = subspaces[0].dim();
+	mNumScales = subspaces[0].numScales();
+
+	int numSubspaces = subspaces.size();
+
+	mLogWeights.resize(numSubspaces, mNumScales);
+	mPrecisions.resize(numSubspaces, mNumScales);
+	mScales.resize(numSubspaces, mNumScales);
+
+	for(int i = 0; i < numSubspaces; ++i) {
+		ArrayXr scales = subspaces[i].scales();
+
+		mLogWeights.row(i) = (subspaces[i].priors().log() - mDim * scales.log()).transpose();
+		mPrecisions.row(i) = scales.square().inverse().transpose();
+		mScales.row(i) = scales.transpose();
+	}
+}
+
+
+
+bool GSMBank::compatible(const vector<GSM>& subspaces) {
+	if(subspaces.empty())
+		return false;
+
+	for(size_t i = 0; i < subspaces.size(); ++i)
+		if(subspaces[i].dim() != subspaces[0].dim()
+			|| subspaces[i].numScales() != subspaces[0].numScales()
+			|| subspaces[i].energyTableTol() > 0.)
+			return false;
+
+	return true;
+}
+
+
+
+void GSMBank::computeEnergy(
+	const MatrixXr& states,
+	Array<real_t, 1, Dynamic>& energy,
+	MatrixXr* gradient) const
+{
+	int numSubspaces = mLogWeights.rows();
+	int numData = states.cols();
+
+	if(states.rows() != numSubspaces * mDim)
+		throw Exception("Hidden states have wrong dimensionality.");
+
+	energy.resize(numData);
+	if(gradient)
+		gradient->resize(states.rows(), numData);
+
+	// hidden states of consecutive data points are stored consecutively, so that a block of
+	// data points can be viewed as a matrix with one column per subspace and data point
+	int blockCols = max(1, kBlockSize / numSubspaces);
+	int numBlocks = (numData + blockCols - 1) / blockCols;
+
+	#pragma omp parallel for if(numBlocks > 1)
+	for(int b = 0; b < numBlocks; ++b) {
+		int offset = b * blockCols;
+		int numCols = min(blockCols, numData - offset);
+
+		Map<const MatrixXr> blockStates(
+			states.data() + static_cast<size_t>(offset) * states.rows(), mDim, numSubspaces * numCols);
+
+		Array<real_t, 1, Dynamic> sqNorms = blockStates.colwise().squaredNorm() / 2.;
+		Map<const ArrayXXr> halfSqNorms(sqNorms.data(), numSubspaces, numCols);
+
+		// log-sum-exp over scales, evaluated for all subspaces and data points at once
+		ArrayXXr maxLogJoint = (halfSqNorms.colwise() * -mPrecisions.col(0)).colwise() + mLogWeights.col(0);
+		for(int k = 1; k < mNumScales; ++k)
+			maxLogJoint = maxLogJoint.max(
+				(halfSqNorms.colwise() * -mPrecisions.col(k)).colwise() + mLogWeights.col(k));
+
+		ArrayXXr sum = ArrayXXr::Zero(numSubspaces, numCols);
+		ArrayXXr weightedSum = ArrayXXr::Zero(numSubspaces, gradient ? numCols : 0);
+		ArrayXXr joint(numSubspaces, numCols);
+
+		for(int k = 0; k < mNumScales; ++k) {
+			joint = (halfSqNorms.colwise() * -mPrecisions.col(k)).colwise()
+				+ mLogWeights.col(k) - maxLogJoint;
+			vexp(joint.data(), joint.data(), joint.size());
+
+			sum += joint;
+			if(gradient)
+				weightedSum += joint.colwise() * mPrecisions.col(k);
+		}
+
+		vlog(sum.data(), joint.data(), sum.size());
+
+		energy.segment(offset, numCols) = -(maxLogJoint + joint).colwise().sum();
+
+		if(gradient) {
+			// posterior expectation of the precision scales the hidden states
+			weightedSum /= sum;
+
+			Map<MatrixXr>(
+				gradient->data() + static_cast<size_t>(offset) * states.rows(), mDim, numSubspaces * numCols) =
+					blockStates.array().rowwise()
+						* Map<Array<real_t, 1, Dynamic> >(weightedSum.data(), numSubspaces * numCols);
+		}
+	}
+}
+
+
+
+void GSMBank::sampleScales(const MatrixXr& states, MatrixXr& scales, RNG& rng) const {
+	int numSubspaces = mLogWeights.rows();
+	int numData = states.cols();
+
+	if(states.rows() != numSubspaces * mDim)
+		throw Exception("Hidden states have wrong dimensionality.");
+
+	scales.resize(states.rows(), numData);
+
+	// each block of random bits provides two uniform random numbers
+	int blocksPerSubspace = (mNumScales + 1) / 2;
+	uint64_t counter = rng.reserve(static_cast<uint64_t>(numData) * numSubspaces * blocksPerSubspace);
+
+	#pragma omp parallel
+	{
+		// perturbations of the log-joints of one data point, one row per scale
+		ArrayXXd noise(mNumScales, numSubspaces);
+
+		#pragma omp for
+		for(int j = 0; j < numData; ++j) {
+			uint32_t bits[4];
+
+			for(int i = 0; i < numSubspaces; ++i) {
+				uint64_t first = counter + (static_cast<uint64_t>(j) * numSubspaces + i) * blocksPerSubspace;
+
+				for(int k = 0; k < mNumScales; ++k) {
+					if(k % 2 == 0)
+						rng.generate(first + k / 2, 0, bits);
+					noise(k, i) = k % 2 ? RNG::toUniform(bits[2], bits[3]) : RNG::toUniform(bits[0], bits[1]);
+				}
+			}
+
+			vlog(noise.data(), noise.data(), noise.size());
+			noise = -noise;
+			vlog(noise.data(), noise.data(), noise.size());
+
+			for(int i = 0; i < numSubspaces; ++i) {
+				double halfSqNorm = states.col(j).segment(i * mDim, mDim).squaredNorm() / 2.;
+				double maxKey = 0.;
+				int index = 0;
+
+				// Gumbel-max trick, see GSM::samplePosterior
+				for(int k = 0; k < mNumScales; ++k) {
+					double key = mLogWeights(i, k) - halfSqNorm * mPrecisions(i, k) - noise(k, i);
+
+					if(k == 0 || key > maxKey) {
+						maxKey = key;
+						index = k;
+					}
+				}
+
+				scales.col(j).segment(i * mDim, mDim).setConstant(mScales(i, index));
+			}
+		}
+	}
+}
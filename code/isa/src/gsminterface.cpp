@@ -61,7 +61,7 @@ PyObject* GSM_num_scales(GSMObject* self, PyObject*, void*) {
 
 
 PyObject* GSM_priors(GSMObject* self, PyObject*, void*) {
-	PyObject* array = PyArray_FromMatrixXd(self->gsm->priors());
+	PyObject* array = PyArray_FromMatrixXr(self->gsm->priors());
 
 	// make array immutable
 	reinterpret_cast<PyArrayObject*>(array)->flags &= ~NPY_WRITEABLE;
@@ -72,7 +72,7 @@ PyObject* GSM_priors(GSMObject* self, PyObject*, void*) {
 
 
 int GSM_set_priors(GSMObject* self, PyObject* value, void*) {
-	PyObject* array = PyArray_FROM_OTF(value, NPY_DOUBLE, NPY_IN_ARRAY);
+	PyObject* array = PyArray_FROM_OTF(value, NPY_REAL, NPY_IN_ARRAY);
 
 	if(!array) {
 		PyErr_SetString(PyExc_TypeError, "Prior weights should be of type `ndarray`.");
@@ -80,7 +80,7 @@ int GSM_set_priors(GSMObject* self, PyObject* value, void*) {
 	}
 
 	try {
-		self->gsm->setPriors(PyArray_ToMatrixXd(array));
+		self->gsm->setPriors(PyArray_ToMatrixXr(array));
 
 	} catch(Exception exception) {
 		Py_DECREF(array);
@@ -96,7 +96,7 @@ int GSM_set_priors(GSMObject* self, PyObject* value, void*) {
 
 
 PyObject* GSM_scales(GSMObject* self, PyObject*, void*) {
-	PyObject* array = PyArray_FromMatrixXd(self->gsm->scales());
+	PyObject* array = PyArray_FromMatrixXr(self->gsm->scales());
 
 	// make array immutable
 	reinterpret_cast<PyArrayObject*>(array)->flags &= ~NPY_WRITEABLE;
@@ -107,7 +107,7 @@ PyObject* GSM_scales(GSMObject* self, PyObject*, void*) {
 
 
 int GSM_set_scales(GSMObject* self, PyObject* value, void*) {
-	PyObject* array = PyArray_FROM_OTF(value, NPY_DOUBLE, NPY_IN_ARRAY);
+	PyObject* array = PyArray_FROM_OTF(value, NPY_REAL, NPY_IN_ARRAY);
 
 	if(!array) {
 		PyErr_SetString(PyExc_TypeError, "Scales should be of type `ndarray`.");
@@ -115,7 +115,7 @@ int GSM_set_scales(GSMObject* self, PyObject* value, void*) {
 	}
 
 	try {
-		self->gsm->setScales(PyArray_ToMatrixXd(array));
+		self->gsm->setScales(PyArray_ToMatrixXr(array));
 
 	} catch(Exception exception) {
 		Py_DECREF(array);
@@ -164,6 +164,29 @@ PyObject* GSM_normalize(GSMObject* self, PyObject*, PyObject*) {
 
 
 
+const char* GSM_seed_doc =
+	"Seeds the random number generator of the distribution.\n"
+	"\n"
+	"@type  seed: C{int}\n"
+	"@param seed: a non-negative integer";
+
+PyObject* GSM_seed(GSMObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"seed", 0};
+
+	unsigned long seed;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "k", const_cast<char**>(kwlist), &seed))
+		return 0;
+
+	self->gsm->seed(seed);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+
 const char* GSM_train_doc =
 	"Optimizes the parameters of the distribution using expectation maximization.\n"
 	"\n"
@@ -194,7 +217,15 @@ PyObject* GSM_train(GSMObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		if(self->gsm->train(PyArray_ToMatrixXd(data), max_iter, tol)) {
+		MatrixXr samples = PyArray_ToMatrixXr(data);
+		bool converged;
+
+		{
+			AllowThreads allowThreads;
+			converged = self->gsm->train(samples, max_iter, tol);
+		}
+
+		if(converged) {
 			Py_INCREF(Py_True);
 			return Py_True;
 		} else {
@@ -211,19 +242,80 @@ PyObject* GSM_train(GSMObject* self, PyObject* args, PyObject* kwds) {
 
 
 
+const char* GSM_partial_fit_doc =
+	"Updates the parameters of the distribution using stochastic expectation maximization.\n"
+	"Each iteration replaces a fraction of the expected sufficient statistics by those\n"
+	"computed from a random batch of data points. The fraction is given by\n"
+	"\n"
+	"\tmin(1, step_width * (1 + t)^(-decay)),\n"
+	"\n"
+	"where t is the number of iterations performed in this and previous calls.\n"
+	"\n"
+	"@type  data: C{ndarray}\n"
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  max_iter: C{int}\n"
+	"@param max_iter: number of stochastic EM iterations (default: 1)\n"
+	"\n"
+	"@type  batch_size: C{int}\n"
+	"@param batch_size: number of data points used in each iteration, 0 uses all (default: 0)\n"
+	"\n"
+	"@type  step_width: C{float}\n"
+	"@param step_width: fraction of statistics replaced in the first iteration (default: 1.)\n"
+	"\n"
+	"@type  decay: C{float}\n"
+	"@param decay: controls how quickly the step width decreases (default: 0.6)";
+
+PyObject* GSM_partial_fit(GSMObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"data", "max_iter", "batch_size", "step_width", "decay", 0};
+
+	PyObject* data;
+	int max_iter = 1;
+	int batch_size = 0;
+	double step_width = 1.;
+	double decay = 0.6;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|iidd", const_cast<char**>(kwlist),
+		&data, &max_iter, &batch_size, &step_width, &decay))
+		return 0;
+
+	// make sure data is stored in NumPy array
+	if(!PyArray_Check(data)) {
+		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
+		return 0;
+	}
+
+	try {
+		self->gsm->trainOnline(PyArray_ToMatrixXr(data), max_iter, batch_size, step_width, decay);
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+
 const char* GSM_posterior_doc =
 	"Computes the posterior over standard deviations.\n"
 	"\n"
 	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns";
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_posterior(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", 0};
+	const char* kwlist[] = {"data", "out", 0};
 
 	PyObject* data;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &data))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -233,7 +325,12 @@ PyObject* GSM_posterior(GSMObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->posterior(PyArray_ToMatrixXd(data)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, self->gsm->numScales(), X.cols());
+
+		return PyArray_FromMatrixXr(self->gsm->posterior(X), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -246,18 +343,24 @@ const char* GSM_sample_doc =
 	"Generates samples from the distribution.\n"
 	"\n"
 	"@type  num_samples: C{int}\n"
-	"@param num_samples: number of samples to generate";
+	"@param num_samples: number of samples to generate\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_sample(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"num_samples", 0};
+	const char* kwlist[] = {"num_samples", "out", 0};
 
 	int num_samples = 1;
+	PyObject* out = 0;
 
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", const_cast<char**>(kwlist), &num_samples))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iO", const_cast<char**>(kwlist), &num_samples, &out))
 		return 0;
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->sample(num_samples));
+		PyArray_CheckOutput(out, self->gsm->dim(), num_samples);
+
+		return PyArray_FromMatrixXr(self->gsm->sample(num_samples), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -270,15 +373,19 @@ const char* GSM_sample_posterior_doc =
 	"Generates samples from the the posterior distribution over standard deviations.\n"
 	"\n"
 	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns";
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_sample_posterior(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", 0};
+	const char* kwlist[] = {"data", "out", 0};
 
 	PyObject* data;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &data))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -288,7 +395,12 @@ PyObject* GSM_sample_posterior(GSMObject* self, PyObject* args, PyObject* kwds)
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->samplePosterior(PyArray_ToMatrixXd(data)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, 1, X.cols());
+
+		return PyArray_FromMatrixXr(self->gsm->samplePosterior(X), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -301,15 +413,19 @@ const char* GSM_loglikelihood_doc =
 	"Computes the log-density of data points.\n"
 	"\n"
 	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns";
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_loglikelihood(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", 0};
+	const char* kwlist[] = {"data", "out", 0};
 
 	PyObject* data;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &data))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -319,7 +435,12 @@ PyObject* GSM_loglikelihood(GSMObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->logLikelihood(PyArray_ToMatrixXd(data)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, 1, X.cols());
+
+		return PyArray_FromMatrixXr(self->gsm->logLikelihood(X), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -332,15 +453,19 @@ const char* GSM_energy_doc =
 	"Computes a negative unnormalized log-density of data points.\n"
 	"\n"
 	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns";
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_energy(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", 0};
+	const char* kwlist[] = {"data", "out", 0};
 
 	PyObject* data;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &data))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -350,7 +475,12 @@ PyObject* GSM_energy(GSMObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->energy(PyArray_ToMatrixXd(data)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, 1, X.cols());
+
+		return PyArray_FromMatrixXr(self->gsm->energy(X), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -363,15 +493,19 @@ const char* GSM_energy_gradient_doc =
 	"Computes the gradient of the energy.\n"
 	"\n"
 	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns";
+	"@param data: data points stored in columns\n"
+	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)";
 
 PyObject* GSM_energy_gradient(GSMObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", 0};
+	const char* kwlist[] = {"data", "out", 0};
 
 	PyObject* data;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &data))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -381,7 +515,12 @@ PyObject* GSM_energy_gradient(GSMObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->gsm->energyGradient(PyArray_ToMatrixXd(data)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, self->gsm->dim(), X.cols());
+
+		return PyArray_FromMatrixXr(self->gsm->energyGradient(X), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -413,7 +552,7 @@ PyObject* GSM_setstate(GSMObject* self, PyObject* state, PyObject*) {
 		return 0;
 
 	try {
-		self->gsm->setScales(PyArray_ToMatrixXd(scales));
+		self->gsm->setScales(PyArray_ToMatrixXr(scales));
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
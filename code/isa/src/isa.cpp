@@ -1,45 +1,89 @@
 #include "isa.h"
 #include "Eigen/LU"
-#include "Eigen/SVD"
+#include "Eigen/QR"
 #include "Eigen/Eigenvalues"
 #include "utils.h"
+#include "memorypool.h"
 #include "lbfgs.h"
 #include <algorithm>
 #include <iostream>
+#include <fstream>
 #include <iomanip>
 #include <cstdlib>
 #include <cmath>
+#include <cstring>
 #include <functional>
 
 using namespace std;
 
-#if LBFGS_FLOAT != 64
-#error "libLBFGS needs to be compiled with double precision."
-#endif
+// minimal length of a previous nullspace basis vector after projection onto the new nullspace
+static const double kMinNullspaceOverlap = 0.5;
 
-static lbfgsfloatval_t evaluateLBFGS(void* instance, const lbfgsfloatval_t* x, lbfgsfloatval_t* g, int, double) {
+// number of data points processed together in a Gibbs update
+static const int kGibbsBlockSize = 256;
+
+// number of data points loaded at once when computing statistics of a data source
+static const int kDataBlockSize = 10000;
+
+// squared norms of the hidden states of each subspace; the norms are stored subspace by
+// subspace, so that per-subspace computations access contiguous memory, while the states are
+// only read once and in the order in which they are stored
+template <class Derived>
+static vector<RowVectorXr> subspaceNorms(const MatrixBase<Derived>& states, const vector<GSM>& subspaces) {
+	int numSubspaces = subspaces.size();
+	int numData = states.cols();
+
+	vector<RowVectorXr> sqNorms(numSubspaces, RowVectorXr(numData));
+
+	#pragma omp parallel for
+	for(int j = 0; j < numData; ++j)
+		for(int f = 0, i = 0; i < numSubspaces; f += subspaces[i].dim(), ++i)
+			sqNorms[i][j] = states.col(j).segment(f, subspaces[i].dim()).squaredNorm();
+
+	return sqNorms;
+}
+
+// the precision of the linked library is not visible to the preprocessor, but shows in the
+// layout of its default parameters, which are written at the library's own offsets
+static bool checkLBFGSPrecision() {
+	union {
+		lbfgs_parameter_t param;
+		char buffer[2 * sizeof(lbfgs_parameter_t)];
+	} defaults;
+
+	memset(&defaults, 0, sizeof(defaults));
+	lbfgs_parameter_init(&defaults.param);
+
+	return defaults.param.epsilon == static_cast<lbfgsfloatval_t>(1e-5)
+		&& defaults.param.delta == static_cast<lbfgsfloatval_t>(1e-5);
+}
+
+static lbfgsfloatval_t evaluateLBFGS(void* instance, const lbfgsfloatval_t* x, lbfgsfloatval_t* g, int, lbfgsfloatval_t) {
 	// unpack user data
-	ISA* isa = static_cast<pair<ISA*, MatrixXd*>*>(instance)->first;
-	const MatrixXd& data = *static_cast<pair<ISA*, const MatrixXd*>*>(instance)->second;
+	ISA* isa = static_cast<pair<ISA*, MatrixXr*>*>(instance)->first;
+	const MatrixXr& data = *static_cast<pair<ISA*, const MatrixXr*>*>(instance)->second;
 
 	// interpret parameters and gradients
 	Map<Matrix<lbfgsfloatval_t, Dynamic, Dynamic> > W(const_cast<lbfgsfloatval_t*>(x), isa->numHiddens(), isa->numHiddens());
 	Map<Matrix<lbfgsfloatval_t, Dynamic, Dynamic> > dW(g, isa->numHiddens(), isa->numHiddens());
 
 	// compute hidden states
-	MatrixXd states = W * data;
+	MatrixXr states = W * data;
 
 	// LU decomposition
-	PartialPivLU<MatrixXd> filterLU(W);
+	PartialPivLU<MatrixXr> filterLU(W);
 
 	// log-determinant of filter matrix
 	double logDet = filterLU.matrixLU().diagonal().array().abs().log().sum();
 
+	// energy and gradient of prior, computed in a single pass
+	pair<MatrixXr, MatrixXr> prior = isa->priorEnergyAndGradient(states);
+
 	// compute gradient
-	dW = isa->priorEnergyGradient(states) * data.transpose() / data.cols() - filterLU.inverse().transpose();
+	dW = prior.second * data.transpose() / data.cols() - filterLU.inverse().transpose();
 
 	// return objective function value
-	return isa->priorEnergy(states).mean() - logDet;
+	return prior.first.cast<double>().mean() - logDet;
 }
 
 
@@ -60,6 +104,7 @@ ISA::Parameters::Parameters() {
 	trainBasis = true;
 	mergeSubspaces = false;
 	orthogonalize = false;
+	energyTableTol = 0.;
 	callback = 0;
 	persistent = true;
 
@@ -82,10 +127,15 @@ ISA::Parameters::Parameters() {
 
 	gsm.maxIter = 10;
 	gsm.tol = 1e-8;
+	gsm.batchSize = 0;
+	gsm.stepWidth = 1.;
+	gsm.decay = 0.6;
 
 	gibbs.verbosity = 0;
 	gibbs.iniIter = 10;
 	gibbs.numIter = 2;
+	gibbs.cacheSize = 0;
+	gibbs.blockSize = 0;
 
 	ais.verbosity = 0;
 	ais.numIter = 100;
@@ -110,6 +160,7 @@ ISA::Parameters::Parameters(const Parameters& params) :
 	mergeSubspaces(params.mergeSubspaces),
 	persistent(params.persistent),
 	orthogonalize(params.orthogonalize),
+	energyTableTol(params.energyTableTol),
 	callback(0),
 	sgd(params.sgd),
 	lbfgs(params.lbfgs),
@@ -147,6 +198,7 @@ ISA::Parameters& ISA::Parameters::operator=(const Parameters& params) {
 	trainBasis = params.trainBasis;
 	mergeSubspaces = params.mergeSubspaces;
 	orthogonalize = params.orthogonalize;
+	energyTableTol = params.energyTableTol;
 	persistent = params.persistent;
 	callback = params.callback ? params.callback->copy() : 0;
 	sgd = params.sgd;
@@ -163,12 +215,17 @@ ISA::Parameters& ISA::Parameters::operator=(const Parameters& params) {
 
 
 
+ISA::BasisCache::BasisCache() : version(-1), nullspaceVersion(-1), logDet(0.) {
+}
+
+
+
 ISA::ISA(int numVisibles, int numHiddens, int sSize, int numScales) :
-	mNumVisibles(numVisibles), mNumHiddens(numHiddens)
+	mNumVisibles(numVisibles), mNumHiddens(numHiddens), mBasisVersion(0)
 {
 	if(mNumHiddens < mNumVisibles)
 		mNumHiddens = mNumVisibles;
-	mBasis = ArrayXXd::Random(mNumVisibles, mNumHiddens) / 10.;
+	mBasis = ArrayXXr::Random(mNumVisibles, mNumHiddens) / 10.;
 
 	for(int i = 0; i < mNumHiddens / sSize; ++i)
 		mSubspaces.push_back(GSM(sSize, numScales));
@@ -179,15 +236,106 @@ ISA::ISA(int numVisibles, int numHiddens, int sSize, int numScales) :
 
 
 
+ISA::ISA(const ISA& isa, const RNG& rng) :
+	mNumVisibles(isa.mNumVisibles),
+	mNumHiddens(isa.mNumHiddens),
+	mBasis(isa.mBasis),
+	mSubspaces(isa.mSubspaces),
+	mRNG(rng),
+	mBasisVersion(0)
+{
+}
+
+
+
 ISA::~ISA() {
 }
 
 
 
-MatrixXd ISA::nullspaceBasis() {
-	// TODO: JacobiSVD is slow, can we replace it with something faster?
-	JacobiSVD<MatrixXd> svd(basis(), ComputeFullV);
-	return svd.matrixV().rightCols(numHiddens() - numVisibles()).transpose();
+MatrixXr ISA::nullspaceBasis() {
+	return basisCache(true).nullspaceBasis;
+}
+
+
+
+MatrixXr ISA::nullspaceProjector() {
+	return basisCache().nullspaceProjector;
+}
+
+
+
+const ISA::BasisCache& ISA::basisCache(bool withNullspaceBasis) {
+	#pragma omp critical (ISA_basisCache)
+	{
+		if(mBasisCache.version != mBasisVersion) {
+			if(complete()) {
+				// LU decomposition
+				PartialPivLU<MatrixXr> basisLU(mBasis);
+
+				mBasisCache.basisInverse = basisLU.inverse();
+				mBasisCache.nullspaceProjector = MatrixXr::Zero(numHiddens(), numHiddens());
+				mBasisCache.logDet = basisLU.matrixLU().diagonal().array().abs().log().sum();
+			} else {
+				mBasisCache.basisLLT.compute(mBasis * mBasis.transpose());
+				mBasisCache.logDet = 2. * mBasisCache.basisLLT.matrixLLT().diagonal().array().log().sum();
+
+				// orthonormal basis of the row space of the basis
+				mBasisCache.rowBasis = mBasisCache.basisLLT.matrixL().solve(mBasis);
+
+				// projection onto the nullspace, I - A^T (A A^T)^{-1} A
+				mBasisCache.nullspaceProjector = MatrixXr::Identity(numHiddens(), numHiddens())
+					- mBasisCache.rowBasis.transpose() * mBasisCache.rowBasis;
+			}
+
+			mBasisCache.version = mBasisVersion;
+		}
+
+		if(withNullspaceBasis && mBasisCache.nullspaceVersion != mBasisVersion) {
+			updateNullspaceBasis();
+			mBasisCache.nullspaceVersion = mBasisVersion;
+		}
+	}
+
+	return mBasisCache;
+}
+
+
+
+void ISA::updateNullspaceBasis() {
+	MatrixXr& B = mBasisCache.nullspaceBasis;
+
+	if(complete()) {
+		B = MatrixXr(0, numHiddens());
+		return;
+	}
+
+	if(B.rows() == numHiddens() - numVisibles() && B.cols() == numHiddens()) {
+		const MatrixXr& R = mBasisCache.rowBasis;
+
+		// remove components of the previous nullspace basis which are no longer orthogonal to the basis
+		MatrixXr C = B * R.transpose();
+		MatrixXr P = B - C * R;
+
+		// since B and R have orthonormal rows, P P^T = I - C C^T
+		MatrixXr G = MatrixXr::Identity(B.rows(), B.rows());
+		G.selfadjointView<Lower>().rankUpdate(C, -1.);
+
+		LLT<MatrixXr> gramLLT(G);
+
+		// only reuse nullspace basis if the basis changed little
+		if(gramLLT.info() == Success && gramLLT.matrixLLT().diagonal().minCoeff() > kMinNullspaceOverlap) {
+			// orthonormalize nullspace basis
+			gramLLT.matrixL().solveInPlace(P);
+			B = P;
+			return;
+		}
+	}
+
+	// the last columns of Q in a QR decomposition of A^T span the nullspace
+	HouseholderQR<MatrixXr> qr(mBasis.transpose());
+	B = (qr.householderQ()
+		* MatrixXr::Identity(numHiddens(), numHiddens()).rightCols(numHiddens() - numVisibles())).transpose();
 }
 
 
@@ -201,10 +349,10 @@ void ISA::initialize() {
 			gaussian = GSM(mSubspaces[i].dim(), 1);
 
 			// sample radial component from Gamma distribution
-			RowVectorXd radial = sampleGamma(1, 10000, mSubspaces[i].dim());
+			RowVectorXr radial = mRNG.gamma(1, 10000, mSubspaces[i].dim());
 
 			// sample from unit sphere and scale by radial component
-			MatrixXd data = normalize(gaussian.sample(10000)).array().rowwise() * radial.array();
+			MatrixXr data = normalize(gaussian.sample(10000, mRNG)).array().rowwise() * radial.array();
 
 			// fit GSM to multivariate Laplace distribution
 			gsm = GSM(mSubspaces[i].dim(), mSubspaces[i].numScales());
@@ -219,33 +367,87 @@ void ISA::initialize() {
 
 
 
-void ISA::initialize(const MatrixXd& data) {
+void ISA::initialize(const MatrixXr& data) {
+	initialize(MatrixSource(data));
+}
+
+
+
+void ISA::initialize(const DataSource& data) {
 	if(data.rows() != numVisibles())
 		throw Exception("Data has wrong dimensionality.");
 
-	// whiten data
-	SelfAdjointEigenSolver<MatrixXd> eigenSolver1(covariance(data));
-	MatrixXd dataWhite = eigenSolver1.operatorInverseSqrt() * data;
+	MatrixXr buffer;
+
+	// compute covariance in double precision, one block at a time
+	VectorXd mean = VectorXd::Zero(data.rows());
+	MatrixXd cov = MatrixXd::Zero(data.rows(), data.rows());
+
+	for(int offset = 0; offset < data.cols(); offset += kDataBlockSize) {
+		int numCols = min(kDataBlockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, kDataBlockSize);
+
+		MatrixXd dataBlock = data.fetch(offset, numCols, buffer).cast<double>();
+		mean += dataBlock.rowwise().sum();
+		cov.selfadjointView<Lower>().rankUpdate(dataBlock);
+	}
+
+	mean /= data.cols();
+	cov = cov.selfadjointView<Lower>();
+	cov = cov / data.cols() - mean * mean.transpose();
+
+	// whitening transform
+	SelfAdjointEigenSolver<MatrixXr> eigenSolver1(cov.cast<real_t>());
+	MatrixXr whiteningMatrix = eigenSolver1.operatorInverseSqrt();
+
+	// squared norms of whitened data points
+	VectorXr sqNorms(data.cols());
+
+	for(int offset = 0; offset < data.cols(); offset += kDataBlockSize) {
+		int numCols = min(kDataBlockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, kDataBlockSize);
+
+		sqNorms.segment(offset, numCols) =
+			(whiteningMatrix * data.fetch(offset, numCols, buffer)).colwise().squaredNorm().transpose();
+	}
 
 	// sort data by norm descending
-	VectorXi indices = argsort(dataWhite.colwise().squaredNorm());
+	VectorXi indices = argsort(sqNorms);
 
 	// largest index of largest 20% data points
 	int N = data.cols() / 5;
 	N = N < numHiddens() ? numHiddens() : N;
 	N = N > data.cols() ? data.cols() : N;
 
-	// store N largest data points and normalize
-	MatrixXd dataWhiteLarge = MatrixXd::Zero(data.rows(), N);
+	// position of each data point among the largest data points
+	vector<int> ranks(data.cols(), -1);
 	for(int i = 0; i < N; ++i)
-		dataWhiteLarge.col(i) = dataWhite.col(indices[i]);
+		ranks[indices[i]] = i;
+
+	// store N largest data points and normalize
+	MatrixXr dataWhiteLarge = MatrixXr::Zero(data.rows(), N);
+
+	for(int offset = 0; offset < data.cols(); offset += kDataBlockSize) {
+		int numCols = min(kDataBlockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, kDataBlockSize);
+
+		const MatrixXr& dataBlock = data.fetch(offset, numCols, buffer);
+
+		for(int j = 0; j < numCols; ++j)
+			if(ranks[offset + j] >= 0)
+				dataWhiteLarge.col(ranks[offset + j]) = whiteningMatrix * dataBlock.col(j);
+	}
+
 	dataWhiteLarge = normalize(dataWhiteLarge);
 
 	// pick first basis vector at random
-	mBasis.col(0) = dataWhiteLarge.col(rand() % N);
+	mBasis.col(0) = dataWhiteLarge.col(static_cast<int>(mRNG.uniform()(0) * N));
 
-	MatrixXd innerProd;
-	MatrixXd::Index j;
+	MatrixXr innerProd;
+	MatrixXr::Index j;
 
 	for(int i = 1; i < min(numHiddens(), N); ++i) {
 		// find data point with maximal inner product to other basis vectors
@@ -255,28 +457,49 @@ void ISA::initialize(const MatrixXd& data) {
 	}
 
 	// orthogonalize and unwhiten
-	SelfAdjointEigenSolver<MatrixXd> eigenSolver2(mBasis * mBasis.transpose());
+	SelfAdjointEigenSolver<MatrixXr> eigenSolver2(mBasis * mBasis.transpose());
 	mBasis = eigenSolver1.operatorSqrt() * eigenSolver2.operatorInverseSqrt() * mBasis;
+
+	invalidateCache();
 }
 
 
 
 void ISA::orthogonalize() {
 	// symmetrically orthogonalize basis
-	SelfAdjointEigenSolver<MatrixXd> eigenSolver1(mBasis * mBasis.transpose());
+	SelfAdjointEigenSolver<MatrixXr> eigenSolver1(mBasis * mBasis.transpose());
 	mBasis = eigenSolver1.operatorInverseSqrt() * mBasis;
+
+	invalidateCache();
+}
+
+
+
+void ISA::train(const MatrixXr& data, Parameters params) {
+	train(MatrixSource(data), params);
 }
 
 
 
-void ISA::train(const MatrixXd& data, Parameters params) {
+void ISA::train(const DataSource& data, Parameters params) {
 	if(data.rows() != numVisibles())
 		throw Exception("Data has wrong dimensionality.");
 
+	bool blockwise = params.gibbs.blockSize > 0
+		&& (params.trainingMethod[0] == 's' || params.trainingMethod[0] == 'S');
+
+	if(!data.matrix() && !blockwise) {
+		// all data points are needed in memory anyway, so copy them only once instead of
+		// in every iteration
+		MatrixXr dataMatrix = data.block(0, data.cols());
+		train(dataMatrix, params);
+		return;
+	}
+
 	if(params.trainingMethod[0] == 'm' or params.trainingMethod[0] == 'M') {
 		if(params.callback && !params.mp.callback)
 			params.mp.callback = params.callback->copy();
-		ISA::trainMP(data, params);
+		ISA::trainMP(*data.matrix(), params);
 		return;
 	}
 
@@ -294,77 +517,43 @@ void ISA::train(const MatrixXd& data, Parameters params) {
 		cout << endl;
 	}
 
+	// temporaries of one iteration reuse the memory of the previous iteration
+	MemoryPool::Scope scope;
+
 	if(mHiddenStates.cols() != data.cols() || mHiddenStates.rows() != numHiddens()) {
 		Parameters iniParams = params;
 		iniParams.gibbs.numIter = iniParams.gibbs.iniIter;
 
 		// initialize hidden states
-		mHiddenStates = samplePosterior(data, iniParams);
+		mHiddenStates.resize(numHiddens(), data.cols());
+		sampleHiddenStates(data, iniParams, false);
 	}
 
 	for(int i = 0; i < params.maxIter; ++i) {
 		// sample hidden states
-		mHiddenStates = params.persistent ?
-			samplePosterior(data, mHiddenStates, params) :
-			samplePosterior(data, params);
+		sampleHiddenStates(data, params, params.persistent);
 
 		if(params.trainPrior)
 			// optimize marginal distributions
-			trainPrior(mHiddenStates, params);
+			trainPrior(mHiddenStates.matrix(), params);
 
  		if(params.mergeSubspaces)
- 			mHiddenStates = mergeSubspaces(mHiddenStates, params);
+ 			mHiddenStates = mergeSubspaces(mHiddenStates.matrix(), params);
 
 		if(params.trainBasis) {
-			const MatrixXd* complBasis;
-			const MatrixXd* complData;
-
-			// complete basis and data
-			if(numHiddens() > numVisibles()) {
-				MatrixXd nullBasis = nullspaceBasis();
-				MatrixXd* complBasisTmp;
-				MatrixXd* complDataTmp;
-
-				// memory is only allocated if model is overcomplete
-				complBasisTmp = new MatrixXd(numHiddens(), numHiddens());
-				complDataTmp = new MatrixXd(numHiddens(), data.cols());
-
-				*complBasisTmp << mBasis, nullBasis;
-				*complDataTmp << data, nullBasis * mHiddenStates;
-				
-				complBasis = complBasisTmp;
-				complData = complDataTmp;
-			} else {
-				complBasis = &mBasis;
-				complData = &data;
-			}
-
-			// optimize basis
-			bool improved;
-
-			switch(params.trainingMethod[0]) {
-				case 's':
-				case 'S':
-					improved = trainSGD(*complData, *complBasis, params);
+			MatrixXr buffer;
 
-					if(params.adaptive)
-						// adjust step width
-						params.sgd.stepWidth *= improved ? 1.1 : 0.5;
-					break;
-
-				case 'l':
-				case 'L':
-					trainLBFGS(*complData, *complBasis, params);
-					break;
+			// approximate prior energies by splines while the basis is optimized
+			setEnergyTableTol(params.energyTableTol);
 
-				default:
-					throw Exception("Unknown training method.");
-			}
+			if(data.matrix() || params.gibbs.blockSize <= 0 || params.trainingMethod[0] == 'l' || params.trainingMethod[0] == 'L')
+				// optimize basis using all data points at once
+				trainBasis(data.fetch(0, data.cols(), buffer), mHiddenStates.matrix(), params);
+			else
+				// data does not fit into memory, pass through the data one block at a time
+				trainBasis(data, params);
 
-			if(numHiddens() > numVisibles()) {
-				delete complBasis;
-				delete complData;
-			}
+			setEnergyTableTol(0.);
 		}
 
 		if(params.verbosity > 0) {
@@ -388,62 +577,309 @@ void ISA::train(const MatrixXd& data, Parameters params) {
 
 
 
-void ISA::trainPrior(const MatrixXd& states, const Parameters& params) {
+void ISA::trainBasis(const MatrixXr& data, const Map<MatrixXr>& states, Parameters& params) {
+	const MatrixXr* complBasis;
+	const MatrixXr* complData;
+
+	// complete basis and data
+	if(numHiddens() > numVisibles()) {
+		MatrixXr nullBasis = nullspaceBasis();
+		MatrixXr* complBasisTmp;
+		MatrixXr* complDataTmp;
+
+		// memory is only allocated if model is overcomplete
+		complBasisTmp = new MatrixXr(numHiddens(), numHiddens());
+		complDataTmp = new MatrixXr(numHiddens(), data.cols());
+
+		*complBasisTmp << mBasis, nullBasis;
+		*complDataTmp << data, nullBasis * states;
+		
+		complBasis = complBasisTmp;
+		complData = complDataTmp;
+	} else {
+		complBasis = &mBasis;
+		complData = &data;
+	}
+
+	// optimize basis
+	bool improved;
+
+	switch(params.trainingMethod[0]) {
+		case 's':
+		case 'S':
+			improved = trainSGD(*complData, *complBasis, params);
+
+			if(params.adaptive)
+				// adjust step width
+				params.sgd.stepWidth *= improved ? 1.1 : 0.5;
+			break;
+
+		case 'l':
+		case 'L':
+			trainLBFGS(*complData, *complBasis, params);
+			break;
+
+		default:
+			throw Exception("Unknown training method.");
+	}
+
+	if(numHiddens() > numVisibles()) {
+		delete complBasis;
+		delete complData;
+	}
+}
+
+
+
+void ISA::trainBasis(const DataSource& data, Parameters& params) {
+	int blockSize = params.gibbs.blockSize;
+
+	// the nullspace is kept fixed while passing through the data
+	MatrixXr nullBasis;
+	MatrixXr complBasis;
+
+	if(numHiddens() > numVisibles()) {
+		nullBasis = nullspaceBasis();
+		complBasis.resize(numHiddens(), numHiddens());
+		complBasis << mBasis, nullBasis;
+	} else {
+		complBasis = mBasis;
+	}
+
+	PartialPivLU<MatrixXr> basisLU(complBasis);
+
+	// filter matrix and momentum are carried over from one block to the next
+	MatrixXr W = basisLU.inverse();
+	MatrixXr P = MatrixXr::Zero(W.rows(), W.cols());
+	MatrixXr X;
+	MatrixXr Y;
+	MatrixXr G;
+	MatrixXr buffer;
+	MatrixXr complData;
+
+	// the lower bound requires additional passes through the data
+	bool computeBound = params.sgd.pocket || params.adaptive;
+	double energy = 0.;
+	double energyNew = 0.;
+
+	if(computeBound) {
+		for(int offset = 0; offset < data.cols(); offset += blockSize) {
+			completeDataBlock(complData, data, nullBasis, offset, min(blockSize, data.cols() - offset), buffer);
+			energy += priorEnergy(W * complData).cast<double>().sum();
+		}
+
+		energy = energy / data.cols() + basisLU.matrixLU().diagonal().array().abs().log().sum();
+	}
+
+	for(int i = 0; i < params.sgd.maxIter; ++i)
+		for(int offset = 0; offset < data.cols(); offset += blockSize) {
+			completeDataBlock(complData, data, nullBasis, offset, min(blockSize, data.cols() - offset), buffer);
+			updateFilterSGD(W, P, complData, params, X, Y, G);
+		}
+
+	PartialPivLU<MatrixXr> filterLU(W);
+
+	if(computeBound) {
+		for(int offset = 0; offset < data.cols(); offset += blockSize) {
+			completeDataBlock(complData, data, nullBasis, offset, min(blockSize, data.cols() - offset), buffer);
+			energyNew += priorEnergy(W * complData).cast<double>().sum();
+		}
+
+		energyNew = energyNew / data.cols() - filterLU.matrixLU().diagonal().array().abs().log().sum();
+	}
+
+	// the basis is only kept or rejected and the step width adapted once per pass
+	if(!params.sgd.pocket || energyNew <= energy)
+		setBasis(filterLU.inverse().topRows(numVisibles()));
+
+	if(params.adaptive)
+		params.sgd.stepWidth *= energyNew < energy ? 1.1 : 0.5;
+}
+
+
+
+void ISA::completeDataBlock(
+	MatrixXr& complData,
+	const DataSource& data,
+	const MatrixXr& nullBasis,
+	int offset,
+	int numCols,
+	MatrixXr& buffer)
+{
+	data.prefetch(offset + numCols, numCols);
+	mHiddenStates.prefetch(offset + numCols, numCols);
+
+	const MatrixXr& dataBlock = data.fetch(offset, numCols, buffer);
+
+	if(!nullBasis.size()) {
+		complData = dataBlock;
+		return;
+	}
+
+	complData.resize(numHiddens(), numCols);
+	complData.topRows(numVisibles()) = dataBlock;
+	complData.bottomRows(nullBasis.rows()).noalias() = nullBasis * mHiddenStates.block(offset, numCols);
+}
+
+
+
+void ISA::updateFilterSGD(
+	MatrixXr& W,
+	MatrixXr& P,
+	const MatrixXr& complData,
+	const Parameters& params,
+	MatrixXr& X,
+	MatrixXr& Y,
+	MatrixXr& G)
+{
+	for(int j = 0; j + params.sgd.batchSize <= complData.cols(); j += params.sgd.batchSize) {
+		X = complData.middleCols(j, params.sgd.batchSize);
+
+		Y.noalias() = W * X;
+		priorEnergyGradientInto(G, Y);
+
+		// update momentum with natural gradient
+		P = params.sgd.momentum * P + W
+			- G * X.transpose() / params.sgd.batchSize * (W.transpose() * W);
+
+		// update filter matrix
+		W += params.sgd.stepWidth * P;
+	}
+}
+
+
+
+void ISA::setEnergyTableTol(double tol) {
+	for(int i = 0; i < numSubspaces(); ++i)
+		mSubspaces[i].setEnergyTableTol(tol);
+}
+
+
+
+void ISA::trainPrior(const MatrixXr& states, const Parameters& params) {
+	// the states are only read
+	trainPrior(Map<MatrixXr>(const_cast<real_t*>(states.data()), states.rows(), states.cols()), params);
+}
+
+
+
+void ISA::trainPrior(const Map<MatrixXr>& states, const Parameters& params) {
 	int from[numSubspaces()];
 	for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
 		from[i] = f;
 
-	#pragma omp parallel for
-	for(int i = 0; i < numSubspaces(); ++i) {
-		mSubspaces[i].train(
-			states.middleRows(from[i], mSubspaces[i].dim()),
-			params.gsm.maxIter,
-			params.gsm.tol);
+	if(params.gsm.batchSize > 0 && params.gsm.batchSize < states.cols()) {
+		int numData = states.cols();
+		MatrixXr batch(states.rows(), params.gsm.batchSize);
+
+		// stochastic EM, all subspaces are updated using the same batch of hidden states
+		for(int k = 0; k < params.gsm.maxIter; ++k) {
+			ArrayXXr urand = mRNG.uniform(1, params.gsm.batchSize);
 
+			for(int j = 0; j < batch.cols(); ++j)
+				batch.col(j) = states.col(min(static_cast<int>(urand(j) * numData), numData - 1));
+
+			#pragma omp parallel for
+			for(int i = 0; i < numSubspaces(); ++i)
+				mSubspaces[i].trainOnline(
+					batch.middleRows(from[i], mSubspaces[i].dim()),
+					1, 0,
+					params.gsm.stepWidth,
+					params.gsm.decay);
+		}
+	} else {
+		vector<RowVectorXr> sqNorms = subspaceNorms(states, mSubspaces);
+
+		#pragma omp parallel for
+		for(int i = 0; i < numSubspaces(); ++i)
+			mSubspaces[i].trainNorms(sqNorms[i], params.gsm.maxIter, params.gsm.tol);
+	}
+
+	for(int i = 0; i < numSubspaces(); ++i) {
 		// normalize marginal variance
 		mBasis.middleCols(from[i], mSubspaces[i].dim()) *= sqrt(mSubspaces[i].variance());
 		mSubspaces[i].normalize();
 	}
+
+	invalidateCache();
+}
+
+
+
+void ISA::sampleHiddenStates(const DataSource& data, const Parameters& params, bool persistent) {
+	int blockSize = params.gibbs.blockSize > 0 ? params.gibbs.blockSize : data.cols();
+	MatrixXr buffer;
+
+	for(int offset = 0; offset < data.cols(); offset += blockSize) {
+		int numCols = min(blockSize, data.cols() - offset);
+
+		// let the operating system read the next block while this one is being sampled
+		data.prefetch(offset + numCols, blockSize);
+		mHiddenStates.prefetch(offset + numCols, blockSize);
+
+		const MatrixXr& X = data.fetch(offset, numCols, buffer);
+
+		Map<MatrixXr> states = mHiddenStates.block(offset, numCols);
+		states = persistent ?
+			samplePosterior(X, states, params) :
+			samplePosterior(X, params);
+	}
+}
+
+
+
+void ISA::mapHiddenStates(const string& filename) {
+	if(mHiddenStates.cols() == 0 && ifstream(filename.c_str()))
+		// continue with chains stored by an earlier run
+		mHiddenStates.open(filename, numHiddens());
+	else
+		mHiddenStates.map(filename);
+}
+
+
+
+void ISA::loadHiddenStates(const string& filename) {
+	mHiddenStates.load(filename, numHiddens());
+}
+
+
+
+void ISA::unmapHiddenStates() {
+	mHiddenStates.unmap();
 }
 
 
 
 bool ISA::trainSGD(
-	const MatrixXd& complData,
-	const MatrixXd& complBasis,
+	const MatrixXr& complData,
+	const MatrixXr& complBasis,
 	const Parameters& params)
 {
 	// LU decomposition
-	PartialPivLU<MatrixXd> basisLU(complBasis);
+	PartialPivLU<MatrixXr> basisLU(complBasis);
 
 	// filter matrix, momentum and batch
-	MatrixXd W = basisLU.inverse();
-	MatrixXd P = MatrixXd::Zero(W.rows(), W.cols());
-	MatrixXd X;
+	MatrixXr W = basisLU.inverse();
+	MatrixXr P = MatrixXr::Zero(W.rows(), W.cols());
+	MatrixXr X;
+
+	// hidden states of a batch and the energy gradient, reused across batches
+	MatrixXr Y;
+	MatrixXr G;
 
 	// compute value of lower bound
 	double logDet = basisLU.matrixLU().diagonal().array().abs().log().sum();
-	double energy = priorEnergy(W * complData).array().mean() + logDet;
-
-	for(int i = 0; i < params.sgd.maxIter; ++i) {
-		for(int j = 0; j + params.sgd.batchSize <= complData.cols(); j += params.sgd.batchSize) {
-			X = complData.middleCols(j, params.sgd.batchSize);
+	double energy = priorEnergy(W * complData).cast<double>().mean() + logDet;
 
-			// update momentum with natural gradient
-			P = params.sgd.momentum * P + W
-				- priorEnergyGradient(W * X) * X.transpose() / params.sgd.batchSize * (W.transpose() * W);
-
-			// update filter matrix
-			W += params.sgd.stepWidth * P;
-		}
-	}
+	for(int i = 0; i < params.sgd.maxIter; ++i)
+		updateFilterSGD(W, P, complData, params, X, Y, G);
 
 	// compute LU decomposition from filter matrix
-	PartialPivLU<MatrixXd> filterLU(W);
+	PartialPivLU<MatrixXr> filterLU(W);
 
 	// compute new value of lower bound
 	double logDetNew = filterLU.matrixLU().diagonal().array().abs().log().sum();
-	double energyNew = priorEnergy(W * complData).array().mean() - logDetNew;
+	double energyNew = priorEnergy(W * complData).cast<double>().mean() - logDetNew;
 
 	if(params.sgd.pocket && energy < energyNew)
 		// don't update basis
@@ -458,12 +894,17 @@ bool ISA::trainSGD(
 
 
 bool ISA::trainLBFGS(
-	const MatrixXd& complData,
-	const MatrixXd& complBasis,
+	const MatrixXr& complData,
+	const MatrixXr& complBasis,
 	const Parameters& params)
 {
+	static const bool lbfgsPrecisionMatches = checkLBFGSPrecision();
+
+	if(!lbfgsPrecisionMatches)
+		throw Exception("libLBFGS needs to be compiled with the same precision as ISA.");
+
 	// compute initial filter matrix
-	MatrixXd W = complBasis.inverse();
+	MatrixXr W = complBasis.inverse();
 
 	// request memory for LBFGS
 	lbfgsfloatval_t* x = lbfgs_malloc(W.size());
@@ -478,7 +919,7 @@ bool ISA::trainLBFGS(
 	param.max_iterations = params.lbfgs.maxIter;
 	param.m = params.lbfgs.numGrad;
 
-	pair<ISA*, const MatrixXd*> instance(this, &complData);
+	pair<ISA*, const MatrixXr*> instance(this, &complData);
 
 	// start LBFGS optimization
 	lbfgs(W.size(), x, 0, &evaluateLBFGS, 0, &instance, &param);
@@ -497,10 +938,10 @@ bool ISA::trainLBFGS(
 
 
 
-void ISA::trainMP(const MatrixXd& data, const Parameters& params) {
+void ISA::trainMP(const MatrixXr& data, const Parameters& params) {
 	// momentum, hidden and visible states
-	MatrixXd P = MatrixXd::Zero(mBasis.rows(), mBasis.cols());
-	MatrixXd X, Y;
+	MatrixXr P = MatrixXr::Zero(mBasis.rows(), mBasis.cols());
+	MatrixXr X, Y;
 
 	// normalize length of basis vectors
 	mBasis = normalize(mBasis);
@@ -522,6 +963,7 @@ void ISA::trainMP(const MatrixXd& data, const Parameters& params) {
 			// update filter matrix
 			mBasis += params.mp.stepWidth * P;
 			mBasis = normalize(mBasis);
+			invalidateCache();
 		}
 
 		if(params.mp.callback)
@@ -537,21 +979,23 @@ void ISA::trainMP(const MatrixXd& data, const Parameters& params) {
 		# pragma omp parallel for
 		for(int j = 0; j < numSubspaces(); ++j) {
 			// orthogonalize subspace
-			MatrixXd subsp = mBasis.middleCols(from[j], mSubspaces[j].dim());
-			SelfAdjointEigenSolver<MatrixXd> eigenSolver(subsp.transpose() * subsp);
+			MatrixXr subsp = mBasis.middleCols(from[j], mSubspaces[j].dim());
+			SelfAdjointEigenSolver<MatrixXr> eigenSolver(subsp.transpose() * subsp);
 			mBasis.middleCols(from[j], mSubspaces[j].dim()) = subsp * eigenSolver.operatorInverseSqrt();
 		}
+
+		invalidateCache();
 	}
 }
 
 
 
-MatrixXd ISA::matchingPursuit(const MatrixXd& data, const Parameters& params) {
-	MatrixXd hiddenStates = MatrixXd::Zero(numHiddens(), data.cols());
+MatrixXr ISA::matchingPursuit(const MatrixXr& data, const Parameters& params) {
+	MatrixXr hiddenStates = MatrixXr::Zero(numHiddens(), data.cols());
 
 	// assumes basis vectors are normalized
-	MatrixXd responses = mBasis.transpose() * data;
-	MatrixXd gramMatrix = mBasis.transpose() * mBasis;
+	MatrixXr responses = mBasis.transpose() * data;
+	MatrixXr gramMatrix = mBasis.transpose() * mBasis;
 
 	if(numSubspaces() == numHiddens()) {
 		for(int i = 0; i < params.mp.numCoeff; ++i) {
@@ -569,7 +1013,7 @@ MatrixXd ISA::matchingPursuit(const MatrixXd& data, const Parameters& params) {
 		}
 	} else {
 		// subspace responses
-		MatrixXd ssResponses = MatrixXd(numSubspaces(), data.cols());
+		MatrixXr ssResponses = MatrixXr(numSubspaces(), data.cols());
 
 		int from[numSubspaces()];
 		for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
@@ -603,21 +1047,28 @@ MatrixXd ISA::matchingPursuit(const MatrixXd& data, const Parameters& params) {
 
 
 
-MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
+MatrixXr ISA::mergeSubspaces(MatrixXr states, const Parameters& params) {
 	if(numSubspaces() > 1) {
 		vector<int> from(numSubspaces());
 		for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
 			from[i] = f;
 
+		// models of subspaces only depend on squared norms of hidden states
+		vector<RowVectorXr> sqNorms = subspaceNorms(states, mSubspaces);
+
+		// rows of hidden states in the order of the merged subspaces
+		vector<int> order(numHiddens());
+		for(int k = 0; k < numHiddens(); ++k)
+			order[k] = k;
+
 		// compute subspace energies
-		MatrixXd energies(numSubspaces(), states.cols());
+		MatrixXr energies(numSubspaces(), states.cols());
 
-		#pragma omp parallel for
 		for(int i = 0; i < numSubspaces(); ++i)
-			energies.row(i) = states.middleRows(from[i], mSubspaces[i].dim()).colwise().norm();
+			energies.row(i) = sqNorms[i].cwiseSqrt();
 
 		// compute correlations between subspaces
-		MatrixXd corr = corrcoef(energies).triangularView<StrictlyLower>();
+		MatrixXr corr = corrcoef(energies).triangularView<StrictlyLower>();
 
 		for(int i = 0; i < params.merge.maxMerge; ++i) {
 			// find the two maximally correlated subspaces
@@ -634,22 +1085,26 @@ MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
 			// makes sure subspaces aren't selected again
 			corr(row, col) = 0.;
 
-			// data corresponding to subspaces
-			MatrixXd statesRow = states.middleRows(from[row], mSubspaces[row].dim());
-			MatrixXd statesCol = states.middleRows(from[col], mSubspaces[col].dim());
-			MatrixXd statesJnt(mSubspaces[row].dim() + mSubspaces[col].dim(), states.cols());
-
-			statesJnt << statesRow, statesCol;
+			// squared norms of the joint subspace
+			RowVectorXr sqNormsJnt = sqNorms[row] + sqNorms[col];
 
 			// train a joint model
-			GSM gsm(statesJnt.rows(), mSubspaces[row].numScales());
+			GSM gsm(mSubspaces[row].dim() + mSubspaces[col].dim(), mSubspaces[row].numScales());
 			gsm.setScales(mSubspaces[row].scales());
-			gsm.train(statesJnt, params.merge.maxIter);
+			gsm.trainNorms(sqNormsJnt, params.merge.maxIter);
+
+			Array<real_t, 1, Dynamic> energyJnt;
+			Array<real_t, 1, Dynamic> energyRow;
+			Array<real_t, 1, Dynamic> energyCol;
 
-			// log-likelihood improvement
-			double mi = gsm.logLikelihood(statesJnt).mean()
-				- mSubspaces[row].logLikelihood(statesRow).mean()
-				- mSubspaces[col].logLikelihood(statesCol).mean();
+			gsm.computeEnergy(sqNormsJnt, energyJnt);
+			mSubspaces[row].computeEnergy(sqNorms[row], energyRow);
+			mSubspaces[col].computeEnergy(sqNorms[col], energyCol);
+
+			// log-likelihood improvement; normalization constants of the Gaussians cancel
+			double mi = energyRow.cast<double>().mean()
+				+ energyCol.cast<double>().mean()
+				- energyJnt.cast<double>().mean();
 
 			if(mi > params.merge.threshold) {
 				mSubspaces.push_back(gsm);
@@ -662,15 +1117,30 @@ MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
 					indices.push_back(from[col] + i);
 
 				// rearrange basis vectors
-				MatrixXd basisRow = mBasis.middleCols(from[row], mSubspaces[row].dim());
-				MatrixXd basisCol = mBasis.middleCols(from[col], mSubspaces[col].dim());
+				MatrixXr basisRow = mBasis.middleCols(from[row], mSubspaces[row].dim());
+				MatrixXr basisCol = mBasis.middleCols(from[col], mSubspaces[col].dim());
 
-				MatrixXd basisDel = deleteCols(mBasis, indices);
+				MatrixXr basisDel = deleteCols(mBasis, indices);
 				mBasis << basisDel, basisRow, basisCol;
+				invalidateCache();
 
 				// rearrange hidden states
-				MatrixXd statesDel = deleteRows(states, indices);
-				states << statesDel, statesJnt;
+				vector<bool> selected(order.size(), false);
+				vector<int> orderJnt;
+				for(unsigned int k = 0; k < indices.size(); ++k) {
+					selected[indices[k]] = true;
+					orderJnt.push_back(order[indices[k]]);
+				}
+
+				vector<int> orderDel;
+				for(unsigned int k = 0; k < order.size(); ++k)
+					if(!selected[k])
+						orderDel.push_back(order[k]);
+
+				order = orderDel;
+				order.insert(order.end(), orderJnt.begin(), orderJnt.end());
+
+				sqNorms.push_back(sqNormsJnt);
 
 				// remove subspaces from correlation matrix
 				vector<int> rc;
@@ -690,11 +1160,15 @@ MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
 					from.erase(from.begin() + row);
 					mSubspaces.erase(mSubspaces.begin() + col);
 					mSubspaces.erase(mSubspaces.begin() + row);
+					sqNorms.erase(sqNorms.begin() + col);
+					sqNorms.erase(sqNorms.begin() + row);
 				} else {
 					from.erase(from.begin() + row);
 					from.erase(from.begin() + col);
 					mSubspaces.erase(mSubspaces.begin() + row);
 					mSubspaces.erase(mSubspaces.begin() + col);
+					sqNorms.erase(sqNorms.begin() + row);
+					sqNorms.erase(sqNorms.begin() + col);
 				}
 
 				if(params.merge.verbosity > 0)
@@ -705,6 +1179,16 @@ MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
 					break;
 			}
 		}
+
+		// hidden states are only rearranged once
+		MatrixXr merged(states.rows(), states.cols());
+
+		#pragma omp parallel for
+		for(int j = 0; j < states.cols(); ++j)
+			for(int k = 0; k < states.rows(); ++k)
+				merged(k, j) = states(order[k], j);
+
+		return merged;
 	}
 
 	return states;
@@ -712,96 +1196,156 @@ MatrixXd ISA::mergeSubspaces(MatrixXd states, const Parameters& params) {
 
 
 
-MatrixXd ISA::sample(int numSamples) {
-	return basis() * samplePrior(numSamples);
+MatrixXr ISA::sample(int numSamples) {
+	return mBasis * samplePrior(numSamples);
 }
 
 
 
-MatrixXd ISA::samplePrior(int numSamples) {
-	MatrixXd samples = MatrixXd::Zero(numHiddens(), numSamples);
-
-	// TODO: parallelize
-	for(int from = 0, i = 0; i < numSubspaces(); from += mSubspaces[i].dim(), ++i)
-		samples.middleRows(from, mSubspaces[i].dim()) =
-			mSubspaces[i].sample(numSamples);
-
+MatrixXr ISA::samplePrior(int numSamples) {
+	MatrixXr samples;
+	samplePriorInto(samples, numSamples);
 	return samples;
 }
 
 
 
-MatrixXd ISA::sampleScales(const MatrixXd& states) {
-	if(states.rows() != numHiddens())
-		throw Exception("Hidden states have wrong dimensionality.");
-
-	MatrixXd scales = MatrixXd::Zero(states.rows(), states.cols());
+void ISA::samplePriorInto(MatrixXr& samples, int numSamples) {
+	// every row is overwritten by one of the subspaces
+	samples.resize(numHiddens(), numSamples);
 
 	int from[numSubspaces()];
 	for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
 		from[i] = f;
 
+	// independent random number streams for each subspace
+	vector<RNG> rngs;
+	for(int i = 0; i < numSubspaces(); ++i)
+		rngs.push_back(mRNG.split());
+
 	#pragma omp parallel for
 	for(int i = 0; i < numSubspaces(); ++i)
-		scales.middleRows(from[i], mSubspaces[i].dim()).rowwise() =
-			mSubspaces[i].samplePosterior(states.middleRows(from[i], mSubspaces[i].dim())).matrix();
+		samples.middleRows(from[i], mSubspaces[i].dim()) =
+			mSubspaces[i].sample(numSamples, rngs[i]);
+}
+
 
+
+MatrixXr ISA::sampleScales(const MatrixXr& states) {
+	MatrixXr scales;
+	sampleScalesInto(scales, states);
 	return scales;
 }
 
 
 
-MatrixXd ISA::samplePosterior(const MatrixXd& data, const Parameters& params) {
+void ISA::sampleScalesInto(MatrixXr& scales, const MatrixXr& states) {
+	if(states.rows() != numHiddens())
+		throw Exception("Hidden states have wrong dimensionality.");
+
+	if(GSMBank::compatible(mSubspaces)) {
+		GSMBank(mSubspaces).sampleScales(states, scales, mRNG);
+		return;
+	}
+
+	vector<RowVectorXr> sqNorms = subspaceNorms(states, mSubspaces);
+	vector<Array<real_t, 1, Dynamic> > subspaceScales(numSubspaces());
+
+	// independent random number streams for each subspace
+	vector<RNG> rngs;
+	for(int i = 0; i < numSubspaces(); ++i)
+		rngs.push_back(mRNG.split());
+
+	#pragma omp parallel for
+	for(int i = 0; i < numSubspaces(); ++i)
+		subspaceScales[i] = mSubspaces[i].samplePosteriorNorms(sqNorms[i], rngs[i]);
+
+	scales.resize(states.rows(), states.cols());
+
+	#pragma omp parallel for
+	for(int j = 0; j < states.cols(); ++j)
+		for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
+			scales.col(j).segment(f, mSubspaces[i].dim()).setConstant(subspaceScales[i][j]);
+}
+
+
+
+// computes Y = WX + Q (Y + diag(v) A^T Z) using matrix-matrix products on blocks of data points
+static void updateSources(
+	MatrixXr& Y,
+	const MatrixXr& WX,
+	const MatrixXr& Q,
+	const MatrixXr& At,
+	const MatrixXr& v,
+	const MatrixXr& Z)
+{
+	int numBlocks = (Y.cols() + kGibbsBlockSize - 1) / kGibbsBlockSize;
+
+	#pragma omp parallel for
+	for(int b = 0; b < numBlocks; ++b) {
+		int offset = b * kGibbsBlockSize;
+		int numCols = min(kGibbsBlockSize, static_cast<int>(Y.cols()) - offset);
+
+		MatrixXr T = v.middleCols(offset, numCols).cwiseProduct(At * Z.middleCols(offset, numCols));
+		T += Y.middleCols(offset, numCols);
+
+		Y.middleCols(offset, numCols) = WX.middleCols(offset, numCols);
+		Y.middleCols(offset, numCols).noalias() += Q * T;
+	}
+}
+
+
+
+MatrixXr ISA::samplePosterior(const MatrixXr& data, const Parameters& params) {
 	return samplePosterior(data, samplePrior(data.cols()), params);
 }
 
 
 
-MatrixXd ISA::samplePosterior(const MatrixXd& data, const MatrixXd& states, const Parameters& params) {
+MatrixXr ISA::samplePosterior(const MatrixXr& data, const MatrixXr& states, const Parameters& params) {
 	if(data.rows() != numVisibles())
 		throw Exception("Data has wrong dimensionality.");
 
 	if(complete())
-		return basis().inverse() * data;
+		return basisCache().basisInverse * data;
 
 	if(data.cols() != states.cols())
 		throw Exception("The number of hidden states and the number of data points should be equal.");
 
-	// scales, variances, and visible states
-	MatrixXd S, v, X;
-
-	// basis and nullspace basis
-	MatrixXd& A = mBasis;
-	MatrixXd B = nullspaceBasis();
-	MatrixXd At = A.transpose();
-	MatrixXd Bt = B.transpose();
+	// variances of source variables
+	MatrixXr v;
 
-	// nullspace projection matrix
-	MatrixXd Q = Bt * B;
+	// factorizations of the basis
+	bool nullspace = useNullspaceCoordinates(params);
+	const BasisCache& cache = basisCache(nullspace);
 
 	// part of the hidden representation
-	MatrixXd WX = At * (A * At).llt().solve(data);
+	MatrixXr WX = mBasis.transpose() * cache.basisLLT.solve(data);
 
 	// initialize Markov chain
-	MatrixXd Y = WX + Q * states;
+	MatrixXr Y = WX + cache.nullspaceProjector * states;
+
+	// solves linear systems for all data points
+	BatchLLT solver(nullspace ? cache.nullspaceBasis : mBasis, params.gibbs.cacheSize);
+
+	// temporaries of one sweep reuse the memory of the previous sweep
+	MemoryPool::Scope scope;
 
 	for(int i = 0; i < params.gibbs.numIter; ++i) {
 		// sample scales
-		S = sampleScales(Y);
-		v = S.array().square();
+		sampleScalesInto(v, Y);
+		v = v.array().square();
 
 		// sample source variables
-		Y = sampleNormal(numHiddens(), data.cols()) * S.array();
-		X = data - A * Y;
+		sampleSources(Y, data, WX, v, solver, nullspace, mRNG);
 
-		#pragma omp parallel for
-		for(int j = 0; j < data.cols(); ++j) {
-			MatrixXd vAt = v.col(j).asDiagonal() * At;
-			Y.col(j) = WX.col(j) + Q * (Y.col(j) + vAt * (A * vAt).llt().solve(X.col(j)));
+		if(params.gibbs.verbosity > 0) {
+			cout << setw(10) << i << setw(12) << fixed << setprecision(4) << priorEnergy(Y).mean();
+			if(params.gibbs.cacheSize > 0)
+				// fraction of linear systems which did not require a new factorization
+				cout << setw(12) << fixed << setprecision(4) << solver.hitRate();
+			cout << endl;
 		}
-
-		if(params.gibbs.verbosity > 0)
-			cout << setw(10) << i << setw(12) << fixed << setprecision(4) << priorEnergy(Y).mean() << endl;
 	}
 
 	return Y;
@@ -809,36 +1353,97 @@ MatrixXd ISA::samplePosterior(const MatrixXd& data, const MatrixXd& states, cons
 
 
 
-pair<MatrixXd, MatrixXd> ISA::samplePosteriorAIS(const MatrixXd& data, const Parameters& params) {
-	VectorXd annealingWeights = VectorXd::LinSpaced(params.ais.numIter + 1, 0.0, 1.0).bottomRows(params.ais.numIter);
+MatrixXr ISA::samplePosterior(const DataSource& data, const Parameters& params) {
+	int blockSize = params.gibbs.blockSize > 0 ? params.gibbs.blockSize : data.cols();
+	MatrixXr buffer;
+
+	MatrixXr states(numHiddens(), data.cols());
+
+	for(int offset = 0; offset < data.cols(); offset += blockSize) {
+		int numCols = min(blockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, blockSize);
+
+		states.middleCols(offset, numCols) = samplePosterior(data.fetch(offset, numCols, buffer), params);
+	}
+
+	return states;
+}
+
+
+
+MatrixXr ISA::samplePosterior(const DataSource& data, const MatrixXr& states, const Parameters& params) {
+	if(data.cols() != states.cols())
+		throw Exception("The number of hidden states and the number of data points should be equal.");
+
+	int blockSize = params.gibbs.blockSize > 0 ? params.gibbs.blockSize : data.cols();
+	MatrixXr buffer;
+
+	if(blockSize >= data.cols())
+		// avoid copying the states
+		return samplePosterior(data.fetch(0, data.cols(), buffer), states, params);
+
+	MatrixXr samples(numHiddens(), data.cols());
+
+	for(int offset = 0; offset < data.cols(); offset += blockSize) {
+		int numCols = min(blockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, blockSize);
+
+		samples.middleCols(offset, numCols) = samplePosterior(
+			data.fetch(offset, numCols, buffer),
+			states.middleCols(offset, numCols),
+			params);
+	}
+
+	return samples;
+}
+
+
+
+pair<MatrixXr, MatrixXr> ISA::samplePosteriorAIS(const MatrixXr& data, const Parameters& params) {
+	RNG rng = mRNG.split();
+	return samplePosteriorAIS(data, params, rng);
+}
+
+
+
+pair<MatrixXr, MatrixXr> ISA::samplePosteriorAIS(
+	const MatrixXr& data,
+	const Parameters& params,
+	RNG& rng)
+{
+	VectorXr annealingWeights = VectorXr::LinSpaced(params.ais.numIter + 1, 0.0, 1.0).bottomRows(params.ais.numIter);
 
 	// initialize proposal distribution to be Gaussian
-	ISA isa = *this;
+	ISA isa(*this, rng);
 
 	for(int j = 0; j < isa.numSubspaces(); ++j)
-		isa.mSubspaces[j].setScales(VectorXd::Ones(isa.mSubspaces[j].numScales()));
+		isa.mSubspaces[j].setScales(VectorXr::Ones(isa.mSubspaces[j].numScales()));
 
-	// scales, variances, and visible states
-	MatrixXd S, v, X;
+	// variances of source variables
+	MatrixXr v;
 
-	// basis and nullspace basis
-	MatrixXd& A = mBasis;
-	MatrixXd B = nullspaceBasis();
-	MatrixXd At = A.transpose();
-	MatrixXd Bt = B.transpose();
-
-	// nullspace projection matrix
-	MatrixXd Q = Bt * B;
+	// factorizations of the basis
+	bool nullspace = useNullspaceCoordinates(params);
+	const BasisCache& cache = basisCache(nullspace);
+	const MatrixXr& Q = cache.nullspaceProjector;
 
 	// part of the hidden representation
-	MatrixXd WX = At * (A * At).llt().solve(data);
+	MatrixXr WX = mBasis.transpose() * cache.basisLLT.solve(data);
 
 	// initialize hidden states
-	MatrixXd Y = WX + Q * isa.samplePrior(data.cols());
+	MatrixXr Y = WX + Q * isa.samplePrior(data.cols());
+
+	// solves linear systems for all data points
+	BatchLLT solver(nullspace ? cache.nullspaceBasis : mBasis);
 
 	// importance weights
-	MatrixXd logWeights = (B * Y).colwise().squaredNorm().array() / 2.
-		+ (numHiddens() - numVisibles()) * log(2. * PI) / 2. - logDetPD(A * At) / 2.;
+	// importance weights are accumulated in double precision
+	ArrayXXd logWeights = Y.cwiseProduct(Q * Y).colwise().sum().cast<double>().array() / 2.
+		+ (numHiddens() - numVisibles()) * log(2. * PI) / 2. - cache.logDet / 2.;
+
+	MemoryPool::Scope scope;
 
 	for(int i = 0; i < params.ais.numIter; ++i) {
 		// adjust proposal distribution
@@ -846,110 +1451,195 @@ pair<MatrixXd, MatrixXd> ISA::samplePosteriorAIS(const MatrixXd& data, const Par
 			isa.mSubspaces[j].setScales(
 				annealingWeights[i] * mSubspaces[j].scales() + (1. - annealingWeights[i]));
 
-		logWeights -= isa.priorEnergy(Y);
+		logWeights -= isa.priorEnergy(Y).array().cast<double>();
 
 		// sample scales
-		S = isa.sampleScales(Y);
-		v = S.array().square();
+		isa.sampleScalesInto(v, Y);
+		v = v.array().square();
 
 		// sample source variables
-		Y = sampleNormal(numHiddens(), data.cols()) * S.array();
-		X = data - A * Y;
+		sampleSources(Y, data, WX, v, solver, nullspace, isa.mRNG);
 
-		#pragma omp parallel for
-		for(int j = 0; j < data.cols(); ++j) {
-			MatrixXd vAt = v.col(j).asDiagonal() * At;
-			Y.col(j) = WX.col(j) + Q * (Y.col(j) + vAt * (A * vAt).llt().solve(X.col(j)));
-		}
-
-		logWeights += isa.priorEnergy(Y);
+		logWeights += isa.priorEnergy(Y).array().cast<double>();
 
 		if(params.ais.verbosity > 0)
 			cout << setw(10) << i << setw(12) << fixed << setprecision(4) << priorEnergy(Y).mean() << endl;
 	}
 
-	logWeights += priorLogLikelihood(Y);
+	logWeights += priorLogLikelihood(Y).array().cast<double>();
 
-	return pair<MatrixXd, MatrixXd>(Y, logWeights);
+	// advance caller's random number generator
+	rng = isa.mRNG;
+
+	return pair<MatrixXr, MatrixXr>(Y, logWeights.cast<real_t>().matrix());
 }
 
 
 
-MatrixXd ISA::sampleNullspace(const MatrixXd& data, const Parameters& params) {
-	return nullspaceBasis() * samplePosterior(data, params);
+void ISA::sampleSources(
+	MatrixXr& states,
+	const MatrixXr& data,
+	const MatrixXr& WX,
+	const MatrixXr& variances,
+	BatchLLT& solver,
+	bool nullspace,
+	RNG& rng)
+{
+	const BasisCache& cache = basisCache(nullspace);
+
+	if(nullspace) {
+		const MatrixXr& B = cache.nullspaceBasis;
+
+		// nullspace coordinates are Gaussian with precision B diag(v)^{-1} B^T
+		MatrixXr precisions = variances.cwiseInverse();
+		MatrixXr inputs = -B * precisions.cwiseProduct(WX);
+		MatrixXr Z;
+
+		solver.sample(precisions, inputs, rng.normal(B.rows(), data.cols()), Z);
+
+		states = WX;
+		states.noalias() += B.transpose() * Z;
+	} else {
+		MatrixXr Z;
+
+		// sample from prior and project onto solutions of A y = x
+		states = rng.normal(numHiddens(), data.cols()) * variances.array().sqrt();
+
+		solver.solve(variances, data - mBasis * states, Z);
+
+		updateSources(states, WX, cache.nullspaceProjector, mBasis.transpose(), variances, Z);
+	}
 }
 
 
 
-MatrixXd ISA::priorLogLikelihood(const MatrixXd& states) {
-	MatrixXd logLik = MatrixXd::Zero(numSubspaces(), states.cols());
+bool ISA::useNullspaceCoordinates(const Parameters& params) {
+	switch(params.samplingMethod[0]) {
+		case 'g':
+		case 'G':
+			return false;
 
-	int from[numSubspaces()];
-	for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
-		from[i] = f;
+		case 'n':
+		case 'N':
+			return true;
 
-	#pragma omp parallel for
-	for(int i = 0; i < numSubspaces(); ++i)
-		logLik.row(i) = mSubspaces[i].logLikelihood(
-			states.middleRows(from[i], mSubspaces[i].dim()));
+		case 'a':
+		case 'A':
+			// pick the formulation with the smaller linear systems
+			return numHiddens() - numVisibles() < numVisibles();
 
-	return logLik.colwise().sum();
+		default:
+			throw Exception("Unknown sampling method.");
+	}
 }
 
 
 
-MatrixXd ISA::priorEnergy(const MatrixXd& states) {
-	MatrixXd energy = MatrixXd::Zero(numSubspaces(), states.cols());
+MatrixXr ISA::sampleNullspace(const MatrixXr& data, const Parameters& params) {
+	MatrixXr Y = samplePosterior(data, params);
+	return basisCache(true).nullspaceBasis * Y;
+}
 
-	int from[numSubspaces()];
-	for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
-		from[i] = f;
 
-	#pragma omp parallel for
-	for(int i = 0; i < numSubspaces(); ++i)
-		energy.row(i) = mSubspaces[i].energy(
-			states.middleRows(from[i], mSubspaces[i].dim()));
 
-	return energy.colwise().sum();
+MatrixXr ISA::priorLogLikelihood(const MatrixXr& states) {
+	Array<real_t, 1, Dynamic> energy;
+
+	computePriorEnergy(states, energy);
+
+	return (-energy - numHiddens() / 2. * log(2. * PI)).matrix();
 }
 
 
 
-MatrixXd ISA::priorEnergyGradient(const MatrixXd& states) {
-	MatrixXd gradient = MatrixXd::Zero(states.rows(), states.cols());
+MatrixXr ISA::priorEnergy(const MatrixXr& states) {
+	Array<real_t, 1, Dynamic> energy;
 
-	int from[numSubspaces()];
-	for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
-		from[i] = f;
+	computePriorEnergy(states, energy);
+
+	return energy.matrix();
+}
+
+
+
+MatrixXr ISA::priorEnergyGradient(const MatrixXr& states) {
+	MatrixXr gradient;
+	priorEnergyGradientInto(gradient, states);
+	return gradient;
+}
+
+
+
+void ISA::priorEnergyGradientInto(MatrixXr& gradient, const MatrixXr& states) {
+	Array<real_t, 1, Dynamic> energy;
+
+	computePriorEnergy(states, energy, &gradient);
+}
+
+
+
+pair<MatrixXr, MatrixXr> ISA::priorEnergyAndGradient(const MatrixXr& states) {
+	Array<real_t, 1, Dynamic> energy;
+	MatrixXr gradient;
+
+	computePriorEnergy(states, energy, &gradient);
+
+	return make_pair(MatrixXr(energy.matrix()), gradient);
+}
+
+
+
+void ISA::computePriorEnergy(
+	const MatrixXr& states,
+	Array<real_t, 1, Dynamic>& energy,
+	MatrixXr* gradient)
+{
+	if(states.rows() != numHiddens())
+		throw Exception("Hidden states have wrong dimensionality.");
+
+	if(GSMBank::compatible(mSubspaces)) {
+		GSMBank(mSubspaces).computeEnergy(states, energy, gradient);
+		return;
+	}
+
+	vector<RowVectorXr> sqNorms = subspaceNorms(states, mSubspaces);
+	vector<Array<real_t, 1, Dynamic> > energies(numSubspaces());
+	vector<Array<real_t, 1, Dynamic> > gradientScales(numSubspaces());
 
 	#pragma omp parallel for
 	for(int i = 0; i < numSubspaces(); ++i)
-		gradient.middleRows(from[i], mSubspaces[i].dim()) =
-			mSubspaces[i].energyGradient(states.middleRows(from[i], mSubspaces[i].dim()));
+		mSubspaces[i].computeEnergy(sqNorms[i], energies[i], gradient ? &gradientScales[i] : 0);
 
-	return gradient;
+	energy = Array<real_t, 1, Dynamic>::Zero(states.cols());
+	for(int i = 0; i < numSubspaces(); ++i)
+		energy += energies[i];
+
+	if(gradient) {
+		gradient->resize(states.rows(), states.cols());
+
+		#pragma omp parallel for
+		for(int j = 0; j < states.cols(); ++j)
+			for(int f = 0, i = 0; i < numSubspaces(); f += mSubspaces[i].dim(), ++i)
+				gradient->col(j).segment(f, mSubspaces[i].dim()) =
+					states.col(j).segment(f, mSubspaces[i].dim()) * gradientScales[i][j];
+	}
 }
 
 
 
-Array<double, 1, Dynamic> ISA::logLikelihood(const MatrixXd& data) {
+Array<real_t, 1, Dynamic> ISA::logLikelihood(const MatrixXr& data) {
 	return logLikelihood(data, Parameters());
 }
 
 
 
-Array<double, 1, Dynamic> ISA::logLikelihood(const MatrixXd& data, const Parameters& params) {
+Array<real_t, 1, Dynamic> ISA::logLikelihood(const MatrixXr& data, const Parameters& params) {
 	if(data.rows() != numVisibles())
 		throw Exception("Data has wrong dimensionality.");
 
 	if(complete()) {
-		// LU decomposition
-		PartialPivLU<MatrixXd> basisLU(mBasis);
-
-		// compute log-determinant of basis
-		double logDet = basisLU.matrixLU().diagonal().array().abs().log().sum();
-
-		return priorLogLikelihood(basisLU.inverse() * data).array() - logDet;
+		const BasisCache& cache = basisCache();
+		return priorLogLikelihood(cache.basisInverse * data).array() - cache.logDet;
 	} else {
 		return logmeanexp(sampleAIS(data, params));
 	}
@@ -957,18 +1647,51 @@ Array<double, 1, Dynamic> ISA::logLikelihood(const MatrixXd& data, const Paramet
 
 
 
-MatrixXd ISA::sampleAIS(const MatrixXd& data, const Parameters& params) {
-	MatrixXd logWeights(params.ais.numSamples, data.cols());
+Array<real_t, 1, Dynamic> ISA::logLikelihood(const DataSource& data, const Parameters& params) {
+	int blockSize = params.gibbs.blockSize > 0 ? params.gibbs.blockSize : data.cols();
+	MatrixXr buffer;
+
+	Array<real_t, 1, Dynamic> logLik(data.cols());
+
+	for(int offset = 0; offset < data.cols(); offset += blockSize) {
+		int numCols = min(blockSize, data.cols() - offset);
+
+		data.prefetch(offset + numCols, blockSize);
+
+		logLik.segment(offset, numCols) = logLikelihood(data.fetch(offset, numCols, buffer), params);
+	}
+
+	return logLik;
+}
+
+
+
+MatrixXr ISA::sampleAIS(const MatrixXr& data, const Parameters& params) {
+	MatrixXr logWeights(params.ais.numSamples, data.cols());
+
+	// independent random number streams for each chain
+	vector<RNG> rngs;
+	for(int i = 0; i < params.ais.numSamples; ++i)
+		rngs.push_back(mRNG.split());
+
+	// factorize basis once before chains are run in parallel
+	basisCache(useNullspaceCoordinates(params));
 
 	#pragma omp parallel for
 	for(int i = 0; i < params.ais.numSamples; ++i)
-		logWeights.row(i) = samplePosteriorAIS(data, params).second;
+		logWeights.row(i) = samplePosteriorAIS(data, params, rngs[i]).second;
 
 	return logWeights;
 }
 
 
 
-double ISA::evaluate(const MatrixXd& data, const Parameters& params) {
-	return -logLikelihood(data, params).mean() / log(2.) / dim();
+double ISA::evaluate(const MatrixXr& data, const Parameters& params) {
+	return -logLikelihood(data, params).cast<double>().mean() / log(2.) / dim();
+}
+
+
+
+double ISA::evaluate(const DataSource& data, const Parameters& params) {
+	return -logLikelihood(data, params).cast<double>().mean() / log(2.) / dim();
 }
@@ -96,6 +96,15 @@ ISA::Parameters PyObject_ToParameters(ISAObject* self, PyObject* parameters) {
 			else if(callback != Py_None)
 				throw Exception("callback should be a function or callable object.");
 
+		PyObject* energy_table_tol = PyDict_GetItemString(parameters, "energy_table_tol");
+		if(energy_table_tol)
+			if(PyFloat_Check(energy_table_tol))
+				params.energyTableTol = PyFloat_AsDouble(energy_table_tol);
+			else if(PyInt_Check(energy_table_tol))
+				params.energyTableTol = static_cast<double>(PyInt_AsLong(energy_table_tol));
+			else
+				throw Exception("energy_table_tol should be of type `float`.");
+
 		PyObject* sgd = PyDict_GetItemString(parameters, "sgd");
 
 		if(!sgd)
@@ -253,6 +262,33 @@ ISA::Parameters PyObject_ToParameters(ISAObject* self, PyObject* parameters) {
 					params.gsm.tol = static_cast<double>(PyInt_AsLong(tol));
 				else
 					throw Exception("gsm.tol should be of type `float`.");
+
+			PyObject* batch_size = PyDict_GetItemString(gsm, "batch_size");
+			if(batch_size)
+				if(PyInt_Check(batch_size))
+					params.gsm.batchSize = PyInt_AsLong(batch_size);
+				else if(PyFloat_Check(batch_size))
+					params.gsm.batchSize = static_cast<int>(PyFloat_AsDouble(batch_size));
+				else
+					throw Exception("gsm.batch_size should be of type `int`.");
+
+			PyObject* step_width = PyDict_GetItemString(gsm, "step_width");
+			if(step_width)
+				if(PyFloat_Check(step_width))
+					params.gsm.stepWidth = PyFloat_AsDouble(step_width);
+				else if(PyInt_Check(step_width))
+					params.gsm.stepWidth = static_cast<double>(PyInt_AsLong(step_width));
+				else
+					throw Exception("gsm.step_width should be of type `float`.");
+
+			PyObject* decay = PyDict_GetItemString(gsm, "decay");
+			if(decay)
+				if(PyFloat_Check(decay))
+					params.gsm.decay = PyFloat_AsDouble(decay);
+				else if(PyInt_Check(decay))
+					params.gsm.decay = static_cast<double>(PyInt_AsLong(decay));
+				else
+					throw Exception("gsm.decay should be of type `float`.");
 		}
 
 		PyObject* gibbs = PyDict_GetItemString(parameters, "gibbs");
@@ -287,6 +323,20 @@ ISA::Parameters PyObject_ToParameters(ISAObject* self, PyObject* parameters) {
 					params.gibbs.numIter = PyInt_AsLong(num_iter);
 				else
 					throw Exception("gibbs.num_iter should be of type `int`.");
+
+			PyObject* cache_size = PyDict_GetItemString(gibbs, "cache_size");
+			if(cache_size)
+				if(PyInt_Check(cache_size))
+					params.gibbs.cacheSize = PyInt_AsLong(cache_size);
+				else
+					throw Exception("gibbs.cache_size should be of type `int`.");
+
+			PyObject* block_size = PyDict_GetItemString(gibbs, "block_size");
+			if(block_size)
+				if(PyInt_Check(block_size))
+					params.gibbs.blockSize = PyInt_AsLong(block_size);
+				else
+					throw Exception("gibbs.block_size should be of type `int`.");
 		}
 
 		PyObject* ais = PyDict_GetItemString(parameters, "ais");
@@ -421,7 +471,7 @@ PyObject* ISA_num_hiddens(ISAObject* self, PyObject*, void*) {
 
 
 PyObject* ISA_A(ISAObject* self, PyObject*, void*) {
-	PyObject* array = PyArray_FromMatrixXd(self->isa->basis());
+	PyObject* array = PyArray_FromMatrixXr(self->isa->basis());
 
 	// make array immutable
 	reinterpret_cast<PyArrayObject*>(array)->flags &= ~NPY_WRITEABLE;
@@ -438,7 +488,7 @@ int ISA_set_A(ISAObject* self, PyObject* value, void*) {
 	}
 
 	try {
-		self->isa->setBasis(PyArray_ToMatrixXd(value));
+		self->isa->setBasis(PyArray_ToMatrixXr(value));
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -459,7 +509,7 @@ const char* ISA_basis_doc =
 
 PyObject* ISA_basis(ISAObject* self, PyObject*, PyObject*) {
 	try {
-		return PyArray_FromMatrixXd(self->isa->basis());
+		return PyArray_FromMatrixXr(self->isa->basis());
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -493,7 +543,7 @@ PyObject* ISA_set_basis(ISAObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		self->isa->setBasis(PyArray_ToMatrixXd(basis));
+		self->isa->setBasis(PyArray_ToMatrixXr(basis));
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -515,7 +565,28 @@ const char* ISA_nullspace_basis_doc =
 
 PyObject* ISA_nullspace_basis(ISAObject* self, PyObject* args, PyObject* kwds) {
 	try {
-		return PyArray_FromMatrixXd(self->isa->nullspaceBasis());
+		return PyArray_FromMatrixXr(self->isa->nullspaceBasis());
+
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	return 0;
+}
+
+
+
+const char* ISA_nullspace_projector_doc =
+	"Computes the orthogonal projection onto the nullspace of the basis matrix,\n"
+	"C{I - A^T (AA^T)^{-1} A}, without computing a basis of the nullspace.\n"
+	"\n"
+	"@rtype: C{ndarray}\n"
+	"@return: projection matrix onto the nullspace of the basis matrix";
+
+PyObject* ISA_nullspace_projector(ISAObject* self, PyObject* args, PyObject* kwds) {
+	try {
+		return PyArray_FromMatrixXr(self->isa->nullspaceProjector());
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -537,7 +608,7 @@ const char* ISA_hidden_states_doc =
 
 PyObject* ISA_hidden_states(ISAObject* self, PyObject*, PyObject*) {
 	try {
-		return PyArray_FromMatrixXd(self->isa->hiddenStates());
+		return PyArray_FromMatrixXr(self->isa->hiddenStates());
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -572,7 +643,52 @@ PyObject* ISA_set_hidden_states(ISAObject* self, PyObject* args, PyObject* kwds)
 	}
 
 	try {
-		self->isa->setHiddenStates(PyArray_ToMatrixXd(states));
+		self->isa->setHiddenStates(PyArray_ToMatrixXr(states));
+
+	} catch(Exception exception) {
+		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		return 0;
+	}
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+
+const char* ISA_map_hidden_states_doc =
+	"Keeps the state of the persistent Markov chain in a memory-mapped file instead of\n"
+	"memory. The current states are moved into the file, which is created or overwritten.\n"
+	"If the model has no states yet but the file exists, the states stored in the file are\n"
+	"used, so that training can continue where an earlier run stopped. Without a filename,\n"
+	"the states are moved back into memory.\n"
+	"\n"
+	"During training, the chains are sampled in blocks of C{gibbs.block_size} data points,\n"
+	"so that only a few blocks need to be in memory at any time. The data itself and the\n"
+	"prior and basis updates still operate on all data points at once.\n"
+	"\n"
+	"A file can only be mapped by one model of a process at a time. Pickling a model whose\n"
+	"states are mapped only stores the name of the file. If the file is still mapped when\n"
+	"the model is restored, for example when a model is copied, the restored model reads\n"
+	"the states into memory instead.\n"
+	"\n"
+	"@type  filename: C{str}\n"
+	"@param filename: file used to store the states of the Markov chain (optional)";
+
+PyObject* ISA_map_hidden_states(ISAObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"filename", 0};
+
+	const char* filename = 0;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|z", const_cast<char**>(kwlist), &filename))
+		return 0;
+
+	try {
+		if(filename)
+			self->isa->mapHiddenStates(filename);
+		else
+			self->isa->unmapHiddenStates();
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
@@ -593,7 +709,7 @@ const char* ISA_subspaces_doc =
 	"return: a list of Gaussian scale mixture distributions";
 
 PyObject* ISA_subspaces(ISAObject* self, PyObject*, PyObject*) {
-	vector<GSM> subspaces = self->isa->subspaces();
+	const vector<GSM>& subspaces = self->isa->subspaces();
 
 	PyObject* list = PyList_New(subspaces.size());
 
@@ -647,7 +763,7 @@ PyObject* ISA_set_subspaces(ISAObject* self, PyObject* args, PyObject* kwds) {
 			subspaces.push_back(*reinterpret_cast<GSMObject*>(gsmObj)->gsm);
 		}
 
-		self->isa->setSubspaces(subspaces);
+		self->isa->setSubspaces(std::move(subspaces));
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_TypeError, exception.message());
@@ -659,6 +775,30 @@ PyObject* ISA_set_subspaces(ISAObject* self, PyObject* args, PyObject* kwds) {
 }
 
 
+const char* ISA_seed_doc =
+	"Seeds the random number generator of the model. Sampling with the same seed\n"
+	"produces identical results, independent of the number of threads used.\n"
+	"\n"
+	"@type  seed: C{int}\n"
+	"@param seed: a non-negative integer";
+
+PyObject* ISA_seed(ISAObject* self, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"seed", 0};
+
+	unsigned long seed;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "k", const_cast<char**>(kwlist), &seed))
+		return 0;
+
+	self->isa->seed(seed);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+
 const char* ISA_default_parameters_doc =
 	"Returns a dictionary of default parameters.\n"
 	"\n"
@@ -725,6 +865,8 @@ PyObject* ISA_default_parameters(ISAObject* self) {
 		Py_INCREF(Py_False);
 	}
 
+	PyDict_SetItemString(parameters, "energy_table_tol", PyFloat_FromDouble(params.energyTableTol));
+
 	PyDict_SetItemString(sgd, "max_iter", PyInt_FromLong(params.sgd.maxIter));
 	PyDict_SetItemString(sgd, "batch_size", PyInt_FromLong(params.sgd.batchSize));
 	PyDict_SetItemString(sgd, "step_width", PyFloat_FromDouble(params.sgd.stepWidth));
@@ -757,10 +899,15 @@ PyObject* ISA_default_parameters(ISAObject* self) {
 
 	PyDict_SetItemString(gsm, "max_iter", PyInt_FromLong(params.gsm.maxIter));
 	PyDict_SetItemString(gsm, "tol", PyFloat_FromDouble(params.gsm.tol));
+	PyDict_SetItemString(gsm, "batch_size", PyInt_FromLong(params.gsm.batchSize));
+	PyDict_SetItemString(gsm, "step_width", PyFloat_FromDouble(params.gsm.stepWidth));
+	PyDict_SetItemString(gsm, "decay", PyFloat_FromDouble(params.gsm.decay));
 
 	PyDict_SetItemString(gibbs, "verbosity", PyInt_FromLong(params.gibbs.verbosity));
 	PyDict_SetItemString(gibbs, "ini_iter", PyInt_FromLong(params.gibbs.iniIter));
 	PyDict_SetItemString(gibbs, "num_iter", PyInt_FromLong(params.gibbs.numIter));
+	PyDict_SetItemString(gibbs, "cache_size", PyInt_FromLong(params.gibbs.cacheSize));
+	PyDict_SetItemString(gibbs, "block_size", PyInt_FromLong(params.gibbs.blockSize));
 
 	PyDict_SetItemString(ais, "verbosity", PyInt_FromLong(params.ais.verbosity));
 	PyDict_SetItemString(ais, "num_iter", PyInt_FromLong(params.ais.numIter));
@@ -798,8 +945,8 @@ const char* ISA_initialize_doc =
 	"one-dimensional. If data points are given, the basis vectors are additionally\n"
 	"using a heuristic.\n"
 	"\n"
-	"@type  data: C{ndarray}\n"
-	"@param data: a set of data points (optional)";
+	"@type  data: C{ndarray}/C{str}\n"
+	"@param data: a set of data points or the name of a .npy file (optional)";
 
 PyObject* ISA_initialize(ISAObject* self, PyObject* args, PyObject* kwds) {
 	const char* kwlist[] = {"data", 0};
@@ -810,21 +957,29 @@ PyObject* ISA_initialize(ISAObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|O", const_cast<char**>(kwlist), &data))
 		return 0;
 
-	// make sure data is stored in NumPy array
-	if(data && !PyArray_Check(data)) {
-		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
-		return 0;
-	}
+	DataSource* source = 0;
 
 	try {
+		if(data) {
+			// make sure data is stored in NumPy array or .npy file
+			source = PyObject_ToDataSource(data);
+
+			if(!source) {
+				PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array or .npy file.");
+				return 0;
+			}
+		}
+
 		self->isa->initialize();
-		if(data)
-			self->isa->initialize(PyArray_ToMatrixXd(data));
+		if(source)
+			self->isa->initialize(*source);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		delete source;
 		return 0;
 	}
 
+	delete source;
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -860,8 +1015,21 @@ const char* ISA_train_doc =
 	"Which method is used is determined by the C{training_method} entry of the dictionary\n"
 	"C{parameters} (either 'MP', 'SGD' or 'LBFGS').\n"
 	"\n"
-	"@type  data: C{ndarray}\n"
-	"@param data: data points stored in columns\n"
+	"If C{energy_table_tol} is positive, energies of the distributions over hidden units\n"
+	"are interpolated from tables while the basis is optimized. The tables are refined\n"
+	"until the interpolation error measured halfway between nodes is below\n"
+	"C{energy_table_tol}. This is an empirical estimate, and the error elsewhere may be\n"
+	"somewhat larger.\n"
+	"\n"
+	"Instead of an array, the name of a .npy file can be given, which will be mapped into\n"
+	"memory. If C{gibbs.block_size} is positive, data points are then sampled and used to\n"
+	"update the basis one block at a time, so that the data does not have to fit into\n"
+	"memory. Each of the C{sgd.max_iter} passes of SGD visits all blocks, and the basis\n"
+	"is evaluated and the step width adapted once after the last pass. LBFGS and\n"
+	"matching pursuit still need all data points at once.\n"
+	"\n"
+	"@type  data: C{ndarray}/C{str}\n"
+	"@param data: data points stored in columns or the name of a .npy file\n"
 	"\n"
 	"@type  parameters: C{dict}\n"
 	"@param parameters: parameters controlling the training method (optional)";
@@ -876,26 +1044,29 @@ PyObject* ISA_train(ISAObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &parameters))
 		return 0;
 
-	data = PyArray_FROM_OTF(data, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
-
-	// make sure data is stored in NumPy array
-	if(!data) {
-		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
-		return 0;
-	}
+	DataSource* source = 0;
 
 	try {
+		// make sure data is stored in NumPy array or .npy file
+		source = PyObject_ToDataSource(data);
+
+		if(!source) {
+			PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array or .npy file.");
+			return 0;
+		}
+
 		ISA::Parameters params = PyObject_ToParameters(self, parameters);
-			
-		// fit model to training data
-		self->isa->train(PyArray_ToMatrixXd(data), params);
+
+		// fit model to training data while other Python threads keep running
+		AllowThreads allowThreads;
+		self->isa->train(*source, params);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
-		Py_DECREF(data);
+		delete source;
 		return 0;
 	}
 
-	Py_DECREF(data);
+	delete source;
 	Py_INCREF(Py_None);
 	return Py_None;
 }
@@ -908,19 +1079,25 @@ const char* ISA_sample_doc =
 	"@type  num_samples: C{int}\n"
 	"@param num_samples: the number of samples to draw\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: samples from the model";
 
 PyObject* ISA_sample(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"num_samples", 0};
+	const char* kwlist[] = {"num_samples", "out", 0};
 
 	int num_samples = 1;
+	PyObject* out = 0;
 
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", const_cast<char**>(kwlist), &num_samples))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iO", const_cast<char**>(kwlist), &num_samples, &out))
 		return 0;
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->sample(num_samples));
+		PyArray_CheckOutput(out, self->isa->numVisibles(), num_samples);
+
+		return PyArray_FromMatrixXr(self->isa->sample(num_samples), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -937,19 +1114,25 @@ const char* ISA_sample_prior_doc =
 	"@type  num_samples: C{int}\n"
 	"@param num_samples: the number of samples to draw\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: samples from the prior over hidden units";
 
 PyObject* ISA_sample_prior(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"num_samples", 0};
+	const char* kwlist[] = {"num_samples", "out", 0};
 
 	int num_samples = 1;
+	PyObject* out = 0;
 
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|i", const_cast<char**>(kwlist), &num_samples))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "|iO", const_cast<char**>(kwlist), &num_samples, &out))
 		return 0;
 
 	try {
- 		return PyArray_FromMatrixXd(self->isa->samplePrior(num_samples));
+		PyArray_CheckOutput(out, self->isa->numHiddens(), num_samples);
+
+		return PyArray_FromMatrixXr(self->isa->samplePrior(num_samples), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -983,7 +1166,7 @@ PyObject* ISA_sample_nullspace(ISAObject* self, PyObject* args, PyObject* kwds)
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &parameters))
 		return 0;
 
-	data = PyArray_FROM_OTF(data, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	data = PyArray_FROM_OTF(data, NPY_REAL, NPY_ALIGNED);
 
 	// make sure data is stored in NumPy array
 	if(!data) {
@@ -992,8 +1175,8 @@ PyObject* ISA_sample_nullspace(ISAObject* self, PyObject* args, PyObject* kwds)
 	}
 
 	try {
-		PyObject* samples = PyArray_FromMatrixXd(self->isa->sampleNullspace(
-			PyArray_ToMatrixXd(data),
+		PyObject* samples = PyArray_FromMatrixXr(self->isa->sampleNullspace(
+			PyArray_ToMatrixXr(data),
 			PyObject_ToParameters(self, parameters)));
 		Py_DECREF(data);
 		return samples;
@@ -1012,8 +1195,13 @@ const char* ISA_sample_posterior_doc =
 	"Draws samples from the posterior distribution over hidden units using Gibbs\n"
 	"sampling or some other method. For each data point, one sample is generated.\n"
 	"\n"
-	"@type  data: C{ndarray}\n"
-	"@param data: states of the visible units\n"
+	"The C{sampling_method} entry of the dictionary C{parameters} determines whether\n"
+	"the Markov chain solves linear systems in the space of visible units ('Gibbs'),\n"
+	"in the nullspace of the basis ('Nullspace'), or in whichever is smaller ('Auto').\n"
+	"All methods have the same stationary distribution.\n"
+	"\n"
+	"@type  data: C{ndarray}/C{str}\n"
+	"@param data: states of the visible units or the name of a .npy file\n"
 	"\n"
 	"@type  parameters: C{dict}\n"
 	"@param parameters: parameters controlling the sampling method (optional)\n"
@@ -1021,60 +1209,73 @@ const char* ISA_sample_posterior_doc =
 	"@type  hidden_states: C{ndarray}\n"
 	"@param hidden_states: initial states for the Markov chain of the sampler (optional)\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: samples from the posterior distribution over hidden units";
 
 PyObject* ISA_sample_posterior(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", "parameters", "hidden_states", 0};
+	const char* kwlist[] = {"data", "parameters", "hidden_states", "out", 0};
 
 	PyObject* data;
 	PyObject* parameters = 0;
 	PyObject* hidden_states = 0;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", const_cast<char**>(kwlist), &data, &parameters, &hidden_states))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|OOO", const_cast<char**>(kwlist), &data, &parameters, &hidden_states, &out))
 		return 0;
 
-	data = PyArray_FROM_OTF(data, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
-
-	// make sure data is stored in NumPy array
-	if(!data) {
-		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
-		return 0;
-	}
-
 	if(hidden_states) {
-		hidden_states = PyArray_FROM_OTF(hidden_states, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+		hidden_states = PyArray_FROM_OTF(hidden_states, NPY_REAL, NPY_ALIGNED);
 
 		if(!hidden_states) {
 			PyErr_SetString(PyExc_TypeError, "Hidden states have to be stored in a NumPy array.");
-			Py_DECREF(data);
 			return 0;
 		}
 	}
 
+	DataSource* source = 0;
+
 	try {
-		PyObject* samples;
-		if(hidden_states)
-			samples = PyArray_FromMatrixXd(self->isa->samplePosterior(
-				PyArray_ToMatrixXd(data),
-				PyArray_ToMatrixXd(hidden_states),
-				PyObject_ToParameters(self, parameters)));
-		else
-			samples = PyArray_FromMatrixXd(self->isa->samplePosterior(
-				PyArray_ToMatrixXd(data),
-				PyObject_ToParameters(self, parameters)));
-		Py_DECREF(data);
+		// make sure data is stored in NumPy array or .npy file
+		source = PyObject_ToDataSource(data);
+
+		if(!source) {
+			PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array or .npy file.");
+			Py_XDECREF(hidden_states);
+			return 0;
+		}
+
+		// check output before sampling
+		PyArray_CheckOutput(out, self->isa->numHiddens(), source->cols());
+
+		ISA::Parameters params = PyObject_ToParameters(self, parameters);
+		MatrixXr states;
+
+		if(hidden_states) {
+			states = PyArray_ToMatrixXr(hidden_states);
+
+			AllowThreads allowThreads;
+			states = self->isa->samplePosterior(*source, states, params);
+		} else {
+			AllowThreads allowThreads;
+			states = self->isa->samplePosterior(*source, params);
+		}
+
+		PyObject* samples = PyArray_FromMatrixXr(std::move(states), out);
+		delete source;
 		Py_XDECREF(hidden_states);
 		return samples;
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
-		Py_DECREF(data);
+		delete source;
 		Py_XDECREF(hidden_states);
 		return 0;
 	}
 
-	Py_DECREF(data);
+	delete source;
 	Py_XDECREF(hidden_states);
 	return 0;
 }
@@ -1105,7 +1306,7 @@ PyObject* ISA_sample_posterior_ais(ISAObject* self, PyObject* args, PyObject* kw
 		return 0;
 
 	// make sure data is stored in contiguous NumPy array
-	data = PyArray_FROM_OTF(data, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	data = PyArray_FROM_OTF(data, NPY_REAL, NPY_ALIGNED);
 
 	if(!data) {
 		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
@@ -1114,11 +1315,16 @@ PyObject* ISA_sample_posterior_ais(ISAObject* self, PyObject* args, PyObject* kw
 
 	try {
 		ISA::Parameters params = PyObject_ToParameters(self, parameters);
+		MatrixXr visibles = PyArray_ToMatrixXr(data);
+		pair<MatrixXr, MatrixXr> result;
 
-		pair<MatrixXd, MatrixXd> result = self->isa->samplePosteriorAIS(PyArray_ToMatrixXd(data), params);
+		{
+			AllowThreads allowThreads;
+			result = self->isa->samplePosteriorAIS(visibles, params);
+		}
 
-		PyObject* samples = PyArray_FromMatrixXd(result.first);
-		PyObject* logWeights = PyArray_FromMatrixXd(result.second);
+		PyObject* samples = PyArray_FromMatrixXr(std::move(result.first));
+		PyObject* logWeights = PyArray_FromMatrixXr(std::move(result.second));
 
 		PyObject* tuple = Py_BuildValue("(OO)", samples, logWeights);
 
@@ -1163,7 +1369,7 @@ PyObject* ISA_sample_ais(ISAObject* self, PyObject* args, PyObject* kwds) {
 		return 0;
 
 	// make sure data is stored in contiguous NumPy array
-	data = PyArray_FROM_OTF(data, NPY_DOUBLE, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+	data = PyArray_FROM_OTF(data, NPY_REAL, NPY_ALIGNED);
 
 	if(!data) {
 		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
@@ -1171,9 +1377,16 @@ PyObject* ISA_sample_ais(ISAObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		PyObject* samples = PyArray_FromMatrixXd(self->isa->sampleAIS(
-			PyArray_ToMatrixXd(data),
-			PyObject_ToParameters(self, parameters)));
+		ISA::Parameters params = PyObject_ToParameters(self, parameters);
+		MatrixXr visibles = PyArray_ToMatrixXr(data);
+		MatrixXr logWeights;
+
+		{
+			AllowThreads allowThreads;
+			logWeights = self->isa->sampleAIS(visibles, params);
+		}
+
+		PyObject* samples = PyArray_FromMatrixXr(std::move(logWeights));
 		Py_DECREF(data);
 		return samples;
 	} catch(Exception exception) {
@@ -1194,16 +1407,20 @@ const char* ISA_sample_scales_doc =
 	"@type  states: C{ndarray}\n"
 	"@param states: states of the hidden units\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: standard deviations";
 
 PyObject* ISA_sample_scales(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"states", 0};
+	const char* kwlist[] = {"states", "out", 0};
 
 	PyObject* states;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &states))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &states, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -1213,7 +1430,12 @@ PyObject* ISA_sample_scales(ISAObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->sampleScales(PyArray_ToMatrixXd(states)));
+		MatrixXr Y = PyArray_ToMatrixXr(states);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, self->isa->numSubspaces(), Y.cols());
+
+		return PyArray_FromMatrixXr(self->isa->sampleScales(Y), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -1235,17 +1457,21 @@ const char* ISA_matching_pursuit_doc =
 	"@type  parameters: C{dict}\n"
 	"@param parameters: parameters controlling the number of active coefficients (optional)\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: inferred states of the hidden units";
 
 PyObject* ISA_matching_pursuit(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"data", "parameters", 0};
+	const char* kwlist[] = {"data", "parameters", "out", 0};
 
 	PyObject* data;
 	PyObject* parameters = 0;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &parameters))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|OO", const_cast<char**>(kwlist), &data, &parameters, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -1255,9 +1481,12 @@ PyObject* ISA_matching_pursuit(ISAObject* self, PyObject* args, PyObject* kwds)
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->matchingPursuit(
-			PyArray_ToMatrixXd(data),
-			PyObject_ToParameters(self, parameters)));
+		MatrixXr X = PyArray_ToMatrixXr(data);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, self->isa->numHiddens(), X.cols());
+
+		return PyArray_FromMatrixXr(self->isa->matchingPursuit(X, PyObject_ToParameters(self, parameters)), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -1273,16 +1502,20 @@ const char* ISA_prior_energy_doc =
 	"@type  states: C{ndarray}\n"
 	"@param states: states of the hidden units\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: energies of the hidden unit states";
 
 PyObject* ISA_prior_energy(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"states", 0};
+	const char* kwlist[] = {"states", "out", 0};
 
 	PyObject* states;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &states))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &states, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -1292,7 +1525,12 @@ PyObject* ISA_prior_energy(ISAObject* self, PyObject* args, PyObject* kwds) {
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->priorEnergy(PyArray_ToMatrixXd(states)));
+		MatrixXr Y = PyArray_ToMatrixXr(states);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, 1, Y.cols());
+
+		return PyArray_FromMatrixXr(self->isa->priorEnergy(Y), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -1308,16 +1546,20 @@ const char* ISA_prior_energy_gradient_doc =
 	"@type  states: C{ndarray}\n"
 	"@param states: states of the hidden units\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: energy gradients of the hidden unit states";
 
 PyObject* ISA_prior_energy_gradient(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"states", 0};
+	const char* kwlist[] = {"states", "out", 0};
 
 	PyObject* states;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &states))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &states, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -1327,7 +1569,12 @@ PyObject* ISA_prior_energy_gradient(ISAObject* self, PyObject* args, PyObject* k
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->priorEnergyGradient(PyArray_ToMatrixXd(states)));
+		MatrixXr Y = PyArray_ToMatrixXr(states);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, self->isa->numHiddens(), Y.cols());
+
+		return PyArray_FromMatrixXr(self->isa->priorEnergyGradient(Y), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -1344,16 +1591,20 @@ const char* ISA_prior_loglikelihood_doc =
 	"@type  states: C{ndarray}\n"
 	"@param states: states of the hidden units\n"
 	"\n"
+	"@type  out: C{ndarray}\n"
+	"@param out: array of the right shape and precision into which the result is written (optional)\n"
+	"\n"
 	"@rtype: C{ndarray}\n"
 	"@return: density evaluated at the given states for the hidden units";
 
 PyObject* ISA_prior_loglikelihood(ISAObject* self, PyObject* args, PyObject* kwds) {
-	const char* kwlist[] = {"states", 0};
+	const char* kwlist[] = {"states", "out", 0};
 
 	PyObject* states;
+	PyObject* out = 0;
 
 	// read arguments
-	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O", const_cast<char**>(kwlist), &states))
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &states, &out))
 		return 0;
 
 	// make sure data is stored in NumPy array
@@ -1363,7 +1614,12 @@ PyObject* ISA_prior_loglikelihood(ISAObject* self, PyObject* args, PyObject* kwd
 	}
 
 	try {
-		return PyArray_FromMatrixXd(self->isa->priorLogLikelihood(PyArray_ToMatrixXd(states)));
+		MatrixXr Y = PyArray_ToMatrixXr(states);
+
+		// check output before computing anything
+		PyArray_CheckOutput(out, 1, Y.cols());
+
+		return PyArray_FromMatrixXr(self->isa->priorLogLikelihood(Y), out);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
 		return 0;
@@ -1381,8 +1637,8 @@ const char* ISA_loglikelihood_doc =
 	"\n"
 	"If C{return_all} is C{True}, all importance weights are returned instead of averaging them.\n"
 	"\n"
-	"@type  data: C{ndarray}\n"
-	"@param data: states of the visible units\n"
+	"@type  data: C{ndarray}/C{str}\n"
+	"@param data: states of the visible units or the name of a .npy file\n"
 	"\n"
 	"@type  parameters: C{dict}\n"
 	"@param parameters: parameters controlling AIS (optional)\n"
@@ -1404,27 +1660,41 @@ PyObject* ISA_loglikelihood(ISAObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|Oi", const_cast<char**>(kwlist), &data, &parameters, &return_all))
 		return 0;
 
-	// make sure data is stored in NumPy array
-	if(!PyArray_Check(data)) {
-		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
-		return 0;
-	}
+	DataSource* source = 0;
 
 	try {
-		if(!self->isa->complete() && return_all)
-			return PyArray_FromMatrixXd(self->isa->sampleAIS(
-				PyArray_ToMatrixXd(data),
-				PyObject_ToParameters(self, parameters)));
-		else
-			return PyArray_FromMatrixXd(self->isa->logLikelihood(
-				PyArray_ToMatrixXd(data),
-				PyObject_ToParameters(self, parameters)));
+		// make sure data is stored in NumPy array or .npy file
+		source = PyObject_ToDataSource(data);
+
+		if(!source) {
+			PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array or .npy file.");
+			return 0;
+		}
+
+		ISA::Parameters params = PyObject_ToParameters(self, parameters);
+		MatrixXr buffer;
+		MatrixXr logLik;
+
+		{
+			AllowThreads allowThreads;
+
+			if(!self->isa->complete() && return_all)
+				logLik = self->isa->sampleAIS(source->fetch(0, source->cols(), buffer), params);
+			else
+				logLik = self->isa->logLikelihood(*source, params).matrix();
+		}
+
+		PyObject* result = PyArray_FromMatrixXr(std::move(logLik));
+		delete source;
+		return result;
 
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		delete source;
 		return 0;
 	}
 
+	delete source;
 	return 0;
 }
 
@@ -1435,8 +1705,8 @@ const char* ISA_evaluate_doc =
 	"will tend to underestimate the log-likelihood if the parameters are not chosen\n"
 	"well enough.\n"
 	"\n"
-	"@type  data: C{ndarray}\n"
-	"@param data: states of the visible units\n"
+	"@type  data: C{ndarray}/C{str}\n"
+	"@param data: states of the visible units or the name of a .npy file\n"
 	"\n"
 	"@type  parameters: C{dict}\n"
 	"@param parameters: parameters controlling AIS (optional)\n"
@@ -1454,21 +1724,34 @@ PyObject* ISA_evaluate(ISAObject* self, PyObject* args, PyObject* kwds) {
 	if(!PyArg_ParseTupleAndKeywords(args, kwds, "O|O", const_cast<char**>(kwlist), &data, &parameters))
 		return 0;
 
-	// make sure data is stored in NumPy array
-	if(!PyArray_Check(data)) {
-		PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array.");
-		return 0;
-	}
+	DataSource* source = 0;
 
 	try {
-		return PyFloat_FromDouble(self->isa->evaluate(
-			PyArray_ToMatrixXd(data),
-			PyObject_ToParameters(self, parameters)));
+		// make sure data is stored in NumPy array or .npy file
+		source = PyObject_ToDataSource(data);
+
+		if(!source) {
+			PyErr_SetString(PyExc_TypeError, "Data has to be stored in a NumPy array or .npy file.");
+			return 0;
+		}
+
+		ISA::Parameters params = PyObject_ToParameters(self, parameters);
+		double value;
+
+		{
+			AllowThreads allowThreads;
+			value = self->isa->evaluate(*source, params);
+		}
+
+		delete source;
+		return PyFloat_FromDouble(value);
 	} catch(Exception exception) {
 		PyErr_SetString(PyExc_RuntimeError, exception.message());
+		delete source;
 		return 0;
 	}
 
+	delete source;
 	return 0;
 }
 
@@ -1478,8 +1761,15 @@ PyObject* ISA_reduce(ISAObject* self, PyObject*, PyObject*) {
 	PyObject* args = Py_BuildValue("(ii)", self->isa->numVisibles(), self->isa->numHiddens());
 
 	PyObject* basis = ISA_basis(self, 0, 0);
-	PyObject* hidden_states = ISA_hidden_states(self, 0, 0);
 	PyObject* subspaces = ISA_subspaces(self, 0, 0);
+	PyObject* hidden_states;
+
+	if(self->isa->hiddenStatesFile().empty())
+		hidden_states = ISA_hidden_states(self, 0, 0);
+	else
+		// avoid copying states which might not fit into memory
+		hidden_states = PyString_FromString(self->isa->hiddenStatesFile().c_str());
+
 	PyObject* state = Py_BuildValue("(OOO)", basis, subspaces, hidden_states);
 	Py_DECREF(basis);
 	Py_DECREF(hidden_states);
@@ -1513,9 +1803,26 @@ PyObject* ISA_setstate(ISAObject* self, PyObject* state, PyObject*) {
 	ISA_set_subspaces(self, args, kwds);
 	Py_DECREF(args);
 
-	args = Py_BuildValue("(O)", hidden_states);
-	ISA_set_hidden_states(self, args, kwds);
-	Py_DECREF(args);
+	if(PyString_Check(hidden_states)) {
+		const char* filename = PyString_AsString(hidden_states);
+
+		try {
+			// a copy of a model made within this process does not share the file with the original
+			if(ChainStore::inUse(filename))
+				self->isa->loadHiddenStates(filename);
+			else
+				self->isa->mapHiddenStates(filename);
+
+		} catch(Exception exception) {
+			PyErr_SetString(PyExc_RuntimeError, exception.message());
+			Py_DECREF(kwds);
+			return 0;
+		}
+	} else {
+		args = Py_BuildValue("(O)", hidden_states);
+		ISA_set_hidden_states(self, args, kwds);
+		Py_DECREF(args);
+	}
 
 	Py_DECREF(kwds);
 
@@ -0,0 +1,289 @@
+#include "memorypool.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+using std::atomic;
+using std::mutex;
+using std::lock_guard;
+using std::memcpy;
+using std::min;
+
+// blocks of class k hold up to 2^(kMinClassBits + k) bytes, including the header
+static const int kMinClassBits = 6;
+static const int kNumClasses = 20;
+
+// larger blocks are returned to the system when they are freed
+static const size_t kMaxBlockSize = static_cast<size_t>(1) << (kMinClassBits + kNumClasses - 1);
+
+// limit on the memory kept by each thread
+static const size_t kMaxCachedBytes = static_cast<size_t>(1) << 26;
+
+// precedes every block and keeps memory behind it aligned
+struct Header {
+	// class of the block, or kNumClasses if the block is not reused
+	size_t sizeClass;
+
+	// number of bytes requested
+	size_t size;
+};
+
+static const size_t kHeaderSize = 16;
+
+// free lists and counters of a single thread
+struct ThreadCache {
+	void* freeLists[kNumClasses];
+	size_t cachedBytes;
+
+	// only contended when the outermost scope ends and another thread empties the cache
+	mutex lock;
+
+	// only written by the owning thread, but read by MemoryPool::statistics
+	atomic<long> numAllocations;
+	atomic<long> numReused;
+
+	ThreadCache* next;
+
+	ThreadCache();
+	~ThreadCache();
+
+	void flush();
+};
+
+// number of existing scopes
+static atomic<int> sNumScopes(0);
+
+// caches of all threads and counters of threads which already finished
+static mutex sMutex;
+static ThreadCache* sCaches = 0;
+static long sNumAllocations = 0;
+static long sNumReused = 0;
+
+static thread_local ThreadCache tCache;
+
+// frees issued after a thread's cache was destroyed go directly to the system
+static thread_local bool tCacheDestroyed = false;
+
+ThreadCache::ThreadCache() : cachedBytes(0), numAllocations(0), numReused(0) {
+	for(int k = 0; k < kNumClasses; ++k)
+		freeLists[k] = 0;
+
+	lock_guard<mutex> lock(sMutex);
+	next = sCaches;
+	sCaches = this;
+}
+
+
+
+ThreadCache::~ThreadCache() {
+	{
+		lock_guard<mutex> lock(sMutex);
+
+		sNumAllocations += numAllocations;
+		sNumReused += numReused;
+
+		for(ThreadCache** cache = &sCaches; *cache; cache = &(*cache)->next)
+			if(*cache == this) {
+				*cache = next;
+				break;
+			}
+	}
+
+	lock_guard<mutex> lock(this->lock);
+	flush();
+
+	tCacheDestroyed = true;
+}
+
+
+
+// expects the lock of the cache to be held
+void ThreadCache::flush() {
+	for(int k = 0; k < kNumClasses; ++k)
+		while(freeLists[k]) {
+			void* block = freeLists[k];
+			freeLists[k] = *static_cast<void**>(block);
+			std::free(static_cast<char*>(block) - kHeaderSize);
+		}
+
+	cachedBytes = 0;
+}
+
+
+
+// counters are only written by the owning thread, so no atomic read-modify-write is needed
+static inline void increment(atomic<long>& counter) {
+	counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+
+
+static inline int sizeClass(size_t size) {
+	int k = 0;
+	while((static_cast<size_t>(1) << (kMinClassBits + k)) < size)
+		++k;
+	return k;
+}
+
+
+
+MemoryPool::Scope::Scope() {
+	sNumScopes.fetch_add(1);
+}
+
+
+
+MemoryPool::Scope::~Scope() {
+	if(sNumScopes.fetch_sub(1) == 1) {
+		// return the blocks kept by all threads, including idle worker threads
+		lock_guard<mutex> lock(sMutex);
+
+		for(ThreadCache* cache = sCaches; cache; cache = cache->next) {
+			lock_guard<mutex> cacheLock(cache->lock);
+
+			// a scope which began in the meantime may already reuse the blocks
+			if(sNumScopes.load() == 0)
+				cache->flush();
+		}
+	}
+}
+
+
+
+void* MemoryPool::allocate(size_t size) {
+	bool pooled = sNumScopes.load(std::memory_order_relaxed) > 0
+		&& size + kHeaderSize <= kMaxBlockSize
+		&& !tCacheDestroyed;
+
+	int k = kNumClasses;
+	void* block = 0;
+
+	if(!tCacheDestroyed)
+		increment(tCache.numAllocations);
+
+	if(pooled) {
+		ThreadCache& cache = tCache;
+		lock_guard<mutex> lock(cache.lock);
+
+		k = sizeClass(size + kHeaderSize);
+
+		if(cache.freeLists[k]) {
+			block = cache.freeLists[k];
+			cache.freeLists[k] = *static_cast<void**>(block);
+			cache.cachedBytes -= static_cast<size_t>(1) << (kMinClassBits + k);
+			increment(cache.numReused);
+
+			static_cast<Header*>(static_cast<void*>(static_cast<char*>(block) - kHeaderSize))->size = size;
+
+			return block;
+		}
+	}
+
+	void* raw;
+
+	// whole blocks are allocated, so that they can be reused for requests of the same class
+	if(posix_memalign(&raw, kHeaderSize, pooled ? static_cast<size_t>(1) << (kMinClassBits + k) : size + kHeaderSize))
+		throw std::bad_alloc();
+
+	Header* header = static_cast<Header*>(raw);
+	header->sizeClass = k;
+	header->size = size;
+
+	return static_cast<char*>(raw) + kHeaderSize;
+}
+
+
+
+void* MemoryPool::reallocate(void* ptr, size_t size) {
+	if(!ptr)
+		return allocate(size);
+
+	if(!size) {
+		release(ptr);
+		return 0;
+	}
+
+	Header* header = static_cast<Header*>(static_cast<void*>(static_cast<char*>(ptr) - kHeaderSize));
+
+	// blocks are large enough for all requests of their class
+	if(header->sizeClass < static_cast<size_t>(kNumClasses)
+		&& size + kHeaderSize <= static_cast<size_t>(1) << (kMinClassBits + header->sizeClass))
+	{
+		header->size = size;
+		return ptr;
+	}
+
+	void* result = allocate(size);
+	memcpy(result, ptr, min(size, header->size));
+	release(ptr);
+
+	return result;
+}
+
+
+
+void MemoryPool::release(void* ptr) {
+	if(!ptr)
+		return;
+
+	char* raw = static_cast<char*>(ptr) - kHeaderSize;
+	size_t k = static_cast<Header*>(static_cast<void*>(raw))->sizeClass;
+
+	if(k < static_cast<size_t>(kNumClasses) && sNumScopes.load(std::memory_order_relaxed) > 0 && !tCacheDestroyed) {
+		ThreadCache& cache = tCache;
+		lock_guard<mutex> lock(cache.lock);
+		size_t blockSize = static_cast<size_t>(1) << (kMinClassBits + k);
+
+		if(cache.cachedBytes + blockSize <= kMaxCachedBytes) {
+			// blocks freed by another thread than the allocating one move to this thread
+			*static_cast<void**>(ptr) = cache.freeLists[k];
+			cache.freeLists[k] = ptr;
+			cache.cachedBytes += blockSize;
+			return;
+		}
+	}
+
+	std::free(raw);
+}
+
+
+
+MemoryPool::Statistics MemoryPool::statistics() {
+	lock_guard<mutex> lock(sMutex);
+
+	Statistics statistics = { sNumAllocations, sNumReused };
+
+	for(ThreadCache* cache = sCaches; cache; cache = cache->next) {
+		statistics.numAllocations += cache->numAllocations;
+		statistics.numReused += cache->numReused;
+	}
+
+	return statistics;
+}
+
+
+
+#ifdef EIGEN_USER_ALIGNED_MALLOC
+namespace Eigen {
+	namespace internal {
+		void* user_aligned_malloc(size_t size) {
+			return MemoryPool::allocate(size);
+		}
+
+
+
+		void user_aligned_free(void* ptr) {
+			MemoryPool::release(ptr);
+		}
+
+
+
+		void* user_aligned_realloc(void* ptr, size_t size) {
+			return MemoryPool::reallocate(ptr, size);
+		}
+	}
+}
+#endif
@@ -7,6 +7,7 @@
 #include <time.h>
 #include "isainterface.h"
 #include "gsminterface.h"
+#include "memorypool.h"
 #include "Eigen/Core"
 
 static PyGetSetDef ISA_getset[] = {
@@ -21,11 +22,14 @@ static PyGetSetDef ISA_getset[] = {
 
 static PyMethodDef ISA_methods[] = {
 	{"default_parameters", (PyCFunction)ISA_default_parameters, METH_VARARGS, ISA_default_parameters_doc},
+	{"seed", (PyCFunction)ISA_seed, METH_VARARGS|METH_KEYWORDS, ISA_seed_doc},
 	{"basis", (PyCFunction)ISA_basis, METH_NOARGS, ISA_basis_doc},
 	{"set_basis", (PyCFunction)ISA_set_basis, METH_VARARGS|METH_KEYWORDS, ISA_set_basis_doc},
 	{"hidden_states", (PyCFunction)ISA_hidden_states, METH_NOARGS, ISA_hidden_states_doc},
 	{"set_hidden_states", (PyCFunction)ISA_set_hidden_states, METH_VARARGS|METH_KEYWORDS, ISA_set_hidden_states_doc},
+	{"map_hidden_states", (PyCFunction)ISA_map_hidden_states, METH_VARARGS|METH_KEYWORDS, ISA_map_hidden_states_doc},
 	{"nullspace_basis", (PyCFunction)ISA_nullspace_basis, METH_NOARGS, ISA_nullspace_basis_doc},
+	{"nullspace_projector", (PyCFunction)ISA_nullspace_projector, METH_NOARGS, ISA_nullspace_projector_doc},
 	{"subspaces", (PyCFunction)ISA_subspaces, METH_NOARGS, ISA_subspaces_doc},
 	{"set_subspaces", (PyCFunction)ISA_set_subspaces, METH_VARARGS|METH_KEYWORDS, ISA_set_subspaces_doc},
 	{"initialize", (PyCFunction)ISA_initialize, METH_VARARGS|METH_KEYWORDS, ISA_initialize_doc},
@@ -106,7 +110,9 @@ static PyGetSetDef GSM_getset[] = {
 
 
 static PyMethodDef GSM_methods[] = {
+	{"seed", (PyCFunction)GSM_seed, METH_VARARGS|METH_KEYWORDS, GSM_seed_doc},
 	{"train", (PyCFunction)GSM_train, METH_VARARGS|METH_KEYWORDS, GSM_train_doc},
+	{"partial_fit", (PyCFunction)GSM_partial_fit, METH_VARARGS|METH_KEYWORDS, GSM_partial_fit_doc},
 	{"posterior", (PyCFunction)GSM_posterior, METH_VARARGS|METH_KEYWORDS, GSM_posterior_doc},
 	{"variance", (PyCFunction)GSM_variance, METH_NOARGS, GSM_variance_doc},
 	{"normalize", (PyCFunction)GSM_normalize, METH_NOARGS, GSM_normalize_doc},
@@ -166,17 +172,70 @@ PyTypeObject GSM_type = {
 
 
 
+static const char* seed_doc =
+	"Seeds the random number generator used to initialize new models and the\n"
+	"random number generators of models which haven't been seeded explicitly.\n"
+	"\n"
+	"@type  seed: C{int}\n"
+	"@param seed: a non-negative integer";
+
+static PyObject* seed(PyObject*, PyObject* args, PyObject* kwds) {
+	const char* kwlist[] = {"seed", 0};
+
+	unsigned int seed;
+
+	// read arguments
+	if(!PyArg_ParseTupleAndKeywords(args, kwds, "I", const_cast<char**>(kwlist), &seed))
+		return 0;
+
+	srand(seed);
+
+	Py_INCREF(Py_None);
+	return Py_None;
+}
+
+
+
+static const char* memory_statistics_doc =
+	"Counts requests for memory made while training or sampling. Memory freed during\n"
+	"training or sampling is kept for reuse, so that most requests do not have to be\n"
+	"served by the system.\n"
+	"\n"
+	"@rtype: C{dict}\n"
+	"@return: number of requests (C{allocations}) and of requests served with kept memory (C{reused})";
+
+static PyObject* memory_statistics(PyObject*, PyObject*) {
+	MemoryPool::Statistics statistics = MemoryPool::statistics();
+
+	return Py_BuildValue("{s:l,s:l}",
+		"allocations", statistics.numAllocations,
+		"reused", statistics.numReused);
+}
+
+
+
+static PyMethodDef isa_methods[] = {
+	{"seed", (PyCFunction)seed, METH_VARARGS|METH_KEYWORDS, seed_doc},
+	{"memory_statistics", (PyCFunction)memory_statistics, METH_NOARGS, memory_statistics_doc},
+	{0}
+};
+
+
+
 PyMODINIT_FUNC initisa() {
 	// set random seed
 	timeval time;
 	gettimeofday(&time, 0);
 	srand(time.tv_usec * time.tv_sec);
 
+	// models release the global interpreter lock while training or sampling
+	PyEval_InitThreads();
+
 	// initialize NumPy
 	import_array();
 
 	// create module object
-	PyObject* module = Py_InitModule("isa", 0);
+	PyObject* module = Py_InitModule("isa", isa_methods);
 
 	// initialize types
 	if(PyType_Ready(&ISA_type) < 0)
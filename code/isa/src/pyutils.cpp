@@ -1,7 +1,105 @@
 #include "pyutils.h"
 #include "exception.h"
 
-PyObject* PyArray_FromMatrixXd(const MatrixXd& mat) {
+// data points stored in a NumPy array, which is kept alive as long as it is used
+class PyArraySource : public ArraySource {
+	public:
+		PyArraySource(PyObject* array);
+		virtual ~PyArraySource();
+
+	protected:
+		PyObject* mArray;
+};
+
+
+
+PyArraySource::PyArraySource(PyObject* array) : mArray(array) {
+	Py_INCREF(mArray);
+
+	mData = reinterpret_cast<const char*>(PyArray_DATA(array));
+	mSinglePrecision = PyArray_TYPE(array) == NPY_FLOAT;
+
+	if(PyArray_NDIM(array) == 1) {
+		mRows = PyArray_DIM(array, 0);
+		mCols = 1;
+		mRowStride = PyArray_STRIDE(array, 0);
+		mColStride = mRows * mRowStride;
+	} else {
+		mRows = PyArray_DIM(array, 0);
+		mCols = PyArray_DIM(array, 1);
+		mRowStride = PyArray_STRIDE(array, 0);
+		mColStride = PyArray_STRIDE(array, 1);
+	}
+}
+
+
+
+PyArraySource::~PyArraySource() {
+	Py_DECREF(mArray);
+}
+
+
+// arrays are read in place, whatever the order and strides of their dimensions
+template <class Scalar>
+static MatrixXr PyArray_ToMatrixXr(PyObject* array) {
+	if(PyArray_NDIM(array) != 1 && PyArray_NDIM(array) != 2)
+		throw Exception("Can only handle one- or two-dimensional arrays.");
+
+	const char* data = reinterpret_cast<const char*>(PyArray_DATA(array));
+	npy_intp rows = PyArray_DIM(array, 0);
+	npy_intp cols = PyArray_NDIM(array) == 2 ? PyArray_DIM(array, 1) : 1;
+	npy_intp rowStride = PyArray_STRIDE(array, 0);
+	npy_intp colStride = PyArray_NDIM(array) == 2 ? PyArray_STRIDE(array, 1) : rows * rowStride;
+
+	// Eigen only supports positive strides, so reversed dimensions are read from the other end
+	bool reverseRows = rowStride < 0 && rows > 0;
+	bool reverseCols = colStride < 0 && cols > 0;
+
+	if(reverseRows) {
+		data += (rows - 1) * rowStride;
+		rowStride = -rowStride;
+	}
+
+	if(reverseCols) {
+		data += (cols - 1) * colStride;
+		colStride = -colStride;
+	}
+
+	npy_intp size = sizeof(Scalar);
+
+	if(rowStride % size || colStride % size)
+		throw Exception("Data must be aligned.");
+
+	MatrixXr matrix;
+
+	// columns stored contiguously can be copied with packet operations
+	if(rowStride == size)
+		matrix = Map<const Matrix<Scalar, Dynamic, Dynamic, ColMajor>, Unaligned, OuterStride<> >(
+			reinterpret_cast<const Scalar*>(data), rows, cols,
+			OuterStride<>(colStride / size)).template cast<real_t>();
+	else
+		matrix = Map<const Matrix<Scalar, Dynamic, Dynamic, ColMajor>, Unaligned, Stride<Dynamic, Dynamic> >(
+			reinterpret_cast<const Scalar*>(data), rows, cols,
+			Stride<Dynamic, Dynamic>(colStride / size, rowStride / size)).template cast<real_t>();
+
+	if(reverseRows)
+		matrix = matrix.colwise().reverse().eval();
+	if(reverseCols)
+		matrix = matrix.rowwise().reverse().eval();
+
+	return matrix;
+}
+
+
+
+// frees the memory of a matrix handed over to NumPy
+static void PyCapsule_DeleteMatrixXr(PyObject* capsule) {
+	delete static_cast<MatrixXr*>(PyCapsule_GetPointer(capsule, 0));
+}
+
+
+
+PyObject* PyArray_FromMatrixXr(const MatrixXr& mat) {
 	// matrix dimensionality
 	npy_intp dims[2];
 	dims[0] = mat.rows();
@@ -9,58 +107,184 @@ PyObject* PyArray_FromMatrixXd(const MatrixXd& mat) {
 
 	// allocate PyArray
 	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
-	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, 0, 0, sizeof(double), NPY_C_CONTIGUOUS, 0);
+	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_REAL, 0, 0, sizeof(real_t), NPY_C_CONTIGUOUS, 0);
 	#else
-	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_DOUBLE, 0, 0, sizeof(double), NPY_F_CONTIGUOUS, 0);
+	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_REAL, 0, 0, sizeof(real_t), NPY_F_CONTIGUOUS, 0);
 	#endif
 
+	if(!array)
+		return 0;
+
 	// copy data
-	const double* data = mat.data();
-	double* dataCopy = reinterpret_cast<double*>(PyArray_DATA(array));
+	Map<MatrixXr>(reinterpret_cast<real_t*>(PyArray_DATA(array)), mat.rows(), mat.cols()) = mat;
+
+	return array;
+}
+
+
+
+PyObject* PyArray_FromMatrixXr(MatrixXr&& mat) {
+	if(!mat.size())
+		return PyArray_FromMatrixXr(static_cast<const MatrixXr&>(mat));
+
+	// the array takes over the memory of the matrix, which is freed together with the array
+	MatrixXr* owner = new MatrixXr;
+	owner->swap(mat);
+
+	npy_intp dims[2];
+	dims[0] = owner->rows();
+	dims[1] = owner->cols();
 
-	for(int i = 0; i < mat.size(); ++i)
-		dataCopy[i] = data[i];
+	#ifdef EIGEN_DEFAULT_TO_ROW_MAJOR
+	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_REAL, 0, owner->data(), sizeof(real_t), NPY_CARRAY, 0);
+	#else
+	PyObject* array = PyArray_New(&PyArray_Type, 2, dims, NPY_REAL, 0, owner->data(), sizeof(real_t), NPY_FARRAY, 0);
+	#endif
+
+	if(!array) {
+		delete owner;
+		return 0;
+	}
+
+	PyObject* base = PyCapsule_New(owner, 0, &PyCapsule_DeleteMatrixXr);
+
+	if(!base) {
+		Py_DECREF(array);
+		delete owner;
+		return 0;
+	}
+
+	#ifdef NPY_1_7_API_VERSION
+	PyArray_SetBaseObject(reinterpret_cast<PyArrayObject*>(array), base);
+	#else
+	PyArray_BASE(array) = base;
+	#endif
 
 	return array;
 }
 
 
 
-MatrixXd PyArray_ToMatrixXd(PyObject* array) {
-	if(PyArray_DESCR(array)->type != PyArray_DescrFromType(NPY_DOUBLE)->type)
-		throw Exception("Can only handle arrays of double values.");
+// checks an output array and determines the strides in bytes with which a matrix of the
+// given shape is written into it
+static void outputStrides(PyObject* out, int numRows, int numCols, npy_intp& rowStride, npy_intp& colStride) {
+	if(!PyArray_Check(out) || PyArray_TYPE(out) != NPY_REAL)
+		#if ISA_FLOAT == 32
+		throw Exception("Output has to be stored in a NumPy array of type float32.");
+		#else
+		throw Exception("Output has to be stored in a NumPy array of type float64.");
+		#endif
 
-	if(PyArray_NDIM(array) == 1) {
-		if(PyArray_FLAGS(array) & NPY_F_CONTIGUOUS)
-			return Map<Matrix<double, Dynamic, Dynamic, ColMajor> >(
-				reinterpret_cast<double*>(PyArray_DATA(array)),
-				PyArray_DIM(array, 0), 1);
-
-		else if(PyArray_FLAGS(array) & NPY_C_CONTIGUOUS)
-			return Map<Matrix<double, Dynamic, Dynamic, RowMajor> >(
-				reinterpret_cast<double*>(PyArray_DATA(array)),
-				PyArray_DIM(array, 0), 1);
-
-		else
-			throw Exception("Data must be stored in contiguous memory.");
-
-	} else if(PyArray_NDIM(array) == 2) {
-		if(PyArray_FLAGS(array) & NPY_F_CONTIGUOUS)
-			return Map<Matrix<double, Dynamic, Dynamic, ColMajor> >(
-				reinterpret_cast<double*>(PyArray_DATA(array)),
-				PyArray_DIM(array, 0),
-				PyArray_DIM(array, 1));
-
-		else if(PyArray_FLAGS(array) & NPY_C_CONTIGUOUS)
-			return Map<Matrix<double, Dynamic, Dynamic, RowMajor> >(
-				reinterpret_cast<double*>(PyArray_DATA(array)),
-				PyArray_DIM(array, 0),
-				PyArray_DIM(array, 1));
-
-		else
-			throw Exception("Data must be stored in contiguous memory.");
+	if(!PyArray_ISWRITEABLE(out) || !PyArray_ISALIGNED(out) || !PyArray_ISNOTSWAPPED(out))
+		throw Exception("Output array has to be writeable, aligned and in native byte order.");
 
+	npy_intp rows;
+	npy_intp cols;
+
+	if(PyArray_NDIM(out) == 2) {
+		rows = PyArray_DIM(out, 0);
+		cols = PyArray_DIM(out, 1);
+		rowStride = PyArray_STRIDE(out, 0);
+		colStride = PyArray_STRIDE(out, 1);
+	} else if(PyArray_NDIM(out) == 1 && numRows == 1) {
+		// row vectors may also be written into one-dimensional arrays
+		rows = 1;
+		cols = PyArray_DIM(out, 0);
+		colStride = PyArray_STRIDE(out, 0);
+		rowStride = cols * colStride;
+	} else if(PyArray_NDIM(out) == 1 && numCols == 1) {
+		rows = PyArray_DIM(out, 0);
+		cols = 1;
+		rowStride = PyArray_STRIDE(out, 0);
+		colStride = rows * rowStride;
 	} else {
+		throw Exception("Output array has wrong dimensionality.");
+	}
+
+	if(rows != numRows || cols != numCols)
+		throw Exception("Output array has wrong shape.");
+
+	if(rowStride < 0 || colStride < 0)
+		throw Exception("Output array should not have negative strides.");
+}
+
+
+
+void PyArray_CheckOutput(PyObject* out, int rows, int cols) {
+	if(!out || out == Py_None)
+		return;
+
+	npy_intp rowStride;
+	npy_intp colStride;
+
+	outputStrides(out, rows, cols, rowStride, colStride);
+}
+
+
+
+PyObject* PyArray_FromMatrixXr(MatrixXr&& mat, PyObject* out) {
+	if(!out || out == Py_None)
+		return PyArray_FromMatrixXr(std::move(mat));
+
+	npy_intp rowStride;
+	npy_intp colStride;
+
+	outputStrides(out, mat.rows(), mat.cols(), rowStride, colStride);
+
+	npy_intp size = sizeof(real_t);
+	real_t* data = reinterpret_cast<real_t*>(PyArray_DATA(out));
+
+	if(rowStride == size)
+		Map<MatrixXr, Unaligned, OuterStride<> >(data, mat.rows(), mat.cols(), OuterStride<>(colStride / size)) = mat;
+	else
+		Map<MatrixXr, Unaligned, Stride<Dynamic, Dynamic> >(data, mat.rows(), mat.cols(),
+			Stride<Dynamic, Dynamic>(colStride / size, rowStride / size)) = mat;
+
+	Py_INCREF(out);
+	return out;
+}
+
+
+
+MatrixXr PyArray_ToMatrixXr(PyObject* array) {
+	// single and double precision arrays are converted to the model's precision
+	if(PyArray_DESCR(array)->type == PyArray_DescrFromType(NPY_DOUBLE)->type)
+		return PyArray_ToMatrixXr<double>(array);
+	if(PyArray_DESCR(array)->type == PyArray_DescrFromType(NPY_FLOAT)->type)
+		return PyArray_ToMatrixXr<float>(array);
+
+	throw Exception("Can only handle arrays of float or double values.");
+}
+
+
+
+DataSource* PyObject_ToDataSource(PyObject* data) {
+	if(PyString_Check(data))
+		return new NpySource(PyString_AsString(data));
+
+	// arrays of single or double precision values are used as they are
+	if(PyArray_Check(data)
+		&& (PyArray_TYPE(data) == NPY_FLOAT || PyArray_TYPE(data) == NPY_DOUBLE)
+		&& PyArray_ISALIGNED(data)
+		&& PyArray_ISNOTSWAPPED(data)) {
+		if(PyArray_NDIM(data) != 1 && PyArray_NDIM(data) != 2)
+			throw Exception("Can only handle one- or two-dimensional arrays.");
+		return new PyArraySource(data);
+	}
+
+	// everything else is converted
+	data = PyArray_FROM_OTF(data, NPY_REAL, NPY_F_CONTIGUOUS | NPY_ALIGNED);
+
+	if(!data)
+		return 0;
+
+	if(PyArray_NDIM(data) != 1 && PyArray_NDIM(data) != 2) {
+		Py_DECREF(data);
 		throw Exception("Can only handle one- or two-dimensional arrays.");
 	}
+
+	DataSource* source = new PyArraySource(data);
+	Py_DECREF(data);
+
+	return source;
 }
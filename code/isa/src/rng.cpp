@@ -0,0 +1,163 @@
+#include "rng.h"
+#include "utils.h"
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+
+using std::rand;
+using std::log;
+using std::sqrt;
+using std::cos;
+using std::sin;
+using std::numeric_limits;
+
+// generators with fewer draws than this fill their arrays single-threaded
+static const int kMinParallelBlocks = 4096;
+
+// maps random bits onto the open interval (0, 1) such that the result is exactly representable
+static inline real_t toUniformReal(uint32_t hi, uint32_t lo) {
+	const int digits = numeric_limits<real_t>::digits - 1;
+	uint64_t bits = (static_cast<uint64_t>(hi) << 32 | lo) >> (64 - digits);
+	return static_cast<real_t>((bits + 0.5) / static_cast<double>(static_cast<uint64_t>(1) << digits));
+}
+
+
+
+RNG::RNG() {
+	seed(static_cast<unsigned long>(rand()) << 31 ^ rand());
+}
+
+
+
+RNG::RNG(unsigned long seed) {
+	this->seed(seed);
+}
+
+
+
+void RNG::seed(unsigned long seed) {
+	mKey[0] = static_cast<uint32_t>(seed);
+	mKey[1] = static_cast<uint32_t>(static_cast<uint64_t>(seed) >> 32);
+	mCounter = 0;
+}
+
+
+
+RNG RNG::split() {
+	uint32_t result[4];
+
+	// keys of child generators are drawn from a separate stream
+	generate(reserve(1), 1, result);
+
+	return RNG(static_cast<unsigned long>(result[1]) << 32 | result[0]);
+}
+
+
+
+ArrayXXr RNG::uniform(int m, int n) {
+	ArrayXXr samples(m, n);
+
+	int numBlocks = (samples.size() + 1) / 2;
+	uint64_t counter = reserve(numBlocks);
+	real_t* data = samples.data();
+
+	#pragma omp parallel for if(numBlocks > kMinParallelBlocks)
+	for(int b = 0; b < numBlocks; ++b) {
+		uint32_t result[4];
+		generate(counter + b, 0, result);
+
+		data[2 * b] = toUniformReal(result[0], result[1]);
+		if(2 * b + 1 < samples.size())
+			data[2 * b + 1] = toUniformReal(result[2], result[3]);
+	}
+
+	return samples;
+}
+
+
+
+ArrayXXr RNG::normal(int m, int n) {
+	ArrayXXr samples(m, n);
+
+	int numBlocks = (samples.size() + 1) / 2;
+	uint64_t counter = reserve(numBlocks);
+	real_t* data = samples.data();
+
+	#pragma omp parallel for if(numBlocks > kMinParallelBlocks)
+	for(int b = 0; b < numBlocks; ++b) {
+		uint32_t result[4];
+		generate(counter + b, 0, result);
+
+		// Box-Muller transform
+		double r = sqrt(-2. * log(toUniform(result[0], result[1])));
+		double t = 2. * PI * toUniform(result[2], result[3]);
+
+		data[2 * b] = r * cos(t);
+		if(2 * b + 1 < samples.size())
+			data[2 * b + 1] = r * sin(t);
+	}
+
+	return samples;
+}
+
+
+
+ArrayXXr RNG::gamma(int m, int n, int k) {
+	ArrayXXr samples(m, n);
+
+	// each sample is a sum of k exponentially distributed variables
+	int blocksPerSample = (k + 1) / 2;
+	int numSamples = samples.size();
+	uint64_t counter = reserve(static_cast<uint64_t>(numSamples) * blocksPerSample);
+	real_t* data = samples.data();
+
+	#pragma omp parallel for if(numSamples * blocksPerSample > kMinParallelBlocks)
+	for(int i = 0; i < numSamples; ++i) {
+		uint32_t result[4];
+		double sum = 0.;
+
+		for(int b = 0; b < blocksPerSample; ++b) {
+			generate(counter + static_cast<uint64_t>(i) * blocksPerSample + b, 0, result);
+
+			sum -= log(toUniform(result[0], result[1]));
+			if(2 * b + 1 < k)
+				sum -= log(toUniform(result[2], result[3]));
+		}
+
+		data[i] = sum;
+	}
+
+	return samples;
+}
+
+
+
+void RNG::generate(uint64_t counter, uint32_t stream, uint32_t result[4]) const {
+	uint32_t key[2] = {mKey[0], mKey[1]};
+
+	result[0] = static_cast<uint32_t>(counter);
+	result[1] = static_cast<uint32_t>(counter >> 32);
+	result[2] = stream;
+	result[3] = 0;
+
+	for(int i = 0; i < 10; ++i) {
+		uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * result[0];
+		uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * result[2];
+
+		result[0] = static_cast<uint32_t>(product1 >> 32) ^ result[1] ^ key[0];
+		result[1] = static_cast<uint32_t>(product1);
+		result[2] = static_cast<uint32_t>(product0 >> 32) ^ result[3] ^ key[1];
+		result[3] = static_cast<uint32_t>(product0);
+
+		key[0] += 0x9E3779B9u;
+		key[1] += 0xBB67AE85u;
+	}
+}
+
+
+
+uint64_t RNG::reserve(uint64_t numBlocks) {
+	uint64_t counter = mCounter;
+	mCounter += numBlocks;
+	return counter;
+}
@@ -1,73 +1,42 @@
 #include "Eigen/Cholesky"
 #include "utils.h"
+#include "vecmath.h"
 #include <algorithm>
 #include <vector>
 #include <iostream>
 #include <cstdlib>
 
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
-#include <random>
-#endif
-
 using namespace std;
 
-Array<double, 1, Dynamic> logsumexp(const ArrayXXd& array) {
-	Array<double, 1, Dynamic> arrayMax = array.colwise().maxCoeff() - 1.;
-	return arrayMax + (array.rowwise() - arrayMax).exp().colwise().sum().log();
-}
-
-
-
-Array<double, 1, Dynamic> logmeanexp(const ArrayXXd& array) {
-	Array<double, 1, Dynamic> arrayMax = array.colwise().maxCoeff() - 1.;
-	return arrayMax + (array.rowwise() - arrayMax).exp().colwise().mean().log();
-}
-
-
+Array<real_t, 1, Dynamic> logsumexp(const ArrayXXr& array) {
+	Array<real_t, 1, Dynamic> arrayMax = array.colwise().maxCoeff() - 1.;
 
-#ifdef __GXX_EXPERIMENTAL_CXX0X__
-ArrayXXd sampleNormal(int m, int n) {
-	mt19937 gen(rand());
-	normal_distribution<double> normal;
-	ArrayXXd samples(m, n);
+	ArrayXXr expArray = array.rowwise() - arrayMax;
+	vexp(expArray.data(), expArray.data(), expArray.size());
 
-	for(int i = 0; i < samples.size(); ++i)
-		samples(i) = normal(gen);
+	Array<real_t, 1, Dynamic> sum = expArray.colwise().sum();
+	vlog(sum.data(), sum.data(), sum.size());
 
-	return samples;
+	return arrayMax + sum;
 }
-#else
-ArrayXXd sampleNormal(int m, int n) {
-	ArrayXXd U = ArrayXXd::Random(m, n);
-	ArrayXXd V = ArrayXXd::Random(m, n);
-	ArrayXXd S = U.square() + V.square();
-
-	for(int i = 0; i < S.size(); ++i)
-		while(S(i) == 0. || S(i) > 1.) {
-			U(i) = ArrayXXd::Random(1, 1)(0);
-			V(i) = ArrayXXd::Random(1, 1)(0);
-			S(i) = U(i) * U(i) + V(i) * V(i);
-		}
 
-	// Box-Muller transform
-	return U * (-2. * S.log() / S).sqrt();
-}
-#endif
 
 
+Array<real_t, 1, Dynamic> logmeanexp(const ArrayXXr& array) {
+	Array<real_t, 1, Dynamic> arrayMax = array.colwise().maxCoeff() - 1.;
 
-ArrayXXd sampleGamma(int m, int n, int k) {
-	ArrayXXd samples = ArrayXXd::Zero(m, n);
+	ArrayXXr expArray = array.rowwise() - arrayMax;
+	vexp(expArray.data(), expArray.data(), expArray.size());
 
-	for(int i = 0; i < k; ++i)
-		samples -= ArrayXXd::Random(m, n).abs().log();
+	Array<real_t, 1, Dynamic> mean = expArray.colwise().mean();
+	vlog(mean.data(), mean.data(), mean.size());
 
-	return samples;
+	return arrayMax + mean;
 }
 
 
 
-VectorXi argsort(const VectorXd& data) {
+VectorXi argsort(const VectorXr& data) {
 	// create pairs of values and indices
 	vector<pair<double, int> > pairs(data.size());
 	for(int i = 0; i < data.size(); ++i) {
@@ -88,35 +57,37 @@ VectorXi argsort(const VectorXd& data) {
 
 
 
-MatrixXd covariance(const MatrixXd& data) {
-	MatrixXd data_centered = data.colwise() - data.rowwise().mean().eval();
-	return data_centered * data_centered.transpose() / data.cols();
+MatrixXr covariance(const MatrixXr& data) {
+	// accumulate in double precision
+	MatrixXd data_centered = data.cast<double>();
+	data_centered = data_centered.colwise() - data_centered.rowwise().mean().eval();
+	return (data_centered * data_centered.transpose() / data.cols()).cast<real_t>();
 }
 
 
 
-MatrixXd corrcoef(const MatrixXd& data) {
-	MatrixXd C = covariance(data);
-	VectorXd c = C.diagonal();
+MatrixXr corrcoef(const MatrixXr& data) {
+	MatrixXr C = covariance(data);
+	VectorXr c = C.diagonal();
 	return C.array() / (c * c.transpose()).array().sqrt();
 }
 
 
 
-MatrixXd normalize(const MatrixXd& matrix) {
+MatrixXr normalize(const MatrixXr& matrix) {
 	return matrix.array().rowwise() / matrix.colwise().norm().eval().array();
 }
 
 
 
-double logDetPD(const MatrixXd& matrix) {
+double logDetPD(const MatrixXr& matrix) {
 	return 2. * matrix.llt().matrixLLT().diagonal().array().log().sum();
 }
 
 
 
-MatrixXd deleteRows(const MatrixXd& matrix, vector<int> indices) {
-	MatrixXd result = ArrayXXd::Zero(matrix.rows() - indices.size(), matrix.cols());
+MatrixXr deleteRows(const MatrixXr& matrix, vector<int> indices) {
+	MatrixXr result = ArrayXXr::Zero(matrix.rows() - indices.size(), matrix.cols());
 
 	sort(indices.begin(), indices.end());
 
@@ -135,8 +106,8 @@ MatrixXd deleteRows(const MatrixXd& matrix, vector<int> indices) {
 
 
 
-MatrixXd deleteCols(const MatrixXd& matrix, vector<int> indices) {
-	MatrixXd result = ArrayXXd::Zero(matrix.rows(), matrix.cols() - indices.size());
+MatrixXr deleteCols(const MatrixXr& matrix, vector<int> indices) {
+	MatrixXr result = ArrayXXr::Zero(matrix.rows(), matrix.cols() - indices.size());
 
 	sort(indices.begin(), indices.end());
 
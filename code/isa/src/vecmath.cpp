@@ -0,0 +1,208 @@
+#include "vecmath.h"
+#include <cmath>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// AVX2 kernels are compiled alongside SSE2 kernels and selected at runtime
+#if defined(__SSE2__) && defined(__GNUC__) && !defined(__INTEL_COMPILER) && !defined(ISA_NO_AVX2)
+#define VECMATH_AVX2
+#include <immintrin.h>
+#endif
+
+typedef void (*Kernel)(const double*, double*, int);
+
+#ifdef __SSE2__
+// packet operations on two doubles
+struct SSE2 {
+	typedef __m128d Type;
+	enum { size = 2 };
+
+	static inline Type set1(double a) { return _mm_set1_pd(a); }
+	static inline Type bits(long long a) { return _mm_castsi128_pd(_mm_set1_epi64x(a)); }
+	static inline Type load(const double* p) { return _mm_loadu_pd(p); }
+	static inline void store(double* p, Type a) { _mm_storeu_pd(p, a); }
+	static inline Type add(Type a, Type b) { return _mm_add_pd(a, b); }
+	static inline Type sub(Type a, Type b) { return _mm_sub_pd(a, b); }
+	static inline Type mul(Type a, Type b) { return _mm_mul_pd(a, b); }
+	static inline Type div(Type a, Type b) { return _mm_div_pd(a, b); }
+	static inline Type madd(Type a, Type b, Type c) { return _mm_add_pd(_mm_mul_pd(a, b), c); }
+	static inline Type min(Type a, Type b) { return _mm_min_pd(a, b); }
+	static inline Type max(Type a, Type b) { return _mm_max_pd(a, b); }
+	static inline Type bitAnd(Type a, Type b) { return _mm_and_pd(a, b); }
+	static inline Type bitOr(Type a, Type b) { return _mm_or_pd(a, b); }
+	static inline Type lt(Type a, Type b) { return _mm_cmplt_pd(a, b); }
+	static inline Type eq(Type a, Type b) { return _mm_cmpeq_pd(a, b); }
+	static inline Type nge(Type a, Type b) { return _mm_cmpnge_pd(a, b); }
+	static inline Type select(Type mask, Type a, Type b) {
+		return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+	}
+	static inline Type shiftLeft52(Type a) {
+		return _mm_castsi128_pd(_mm_slli_epi64(_mm_castpd_si128(a), 52));
+	}
+	static inline Type shiftRight52(Type a) {
+		return _mm_castsi128_pd(_mm_srli_epi64(_mm_castpd_si128(a), 52));
+	}
+
+	// rounds to the nearest integer, valid for magnitudes below 2^51
+	static inline Type round(Type a) {
+		Type magic = _mm_set1_pd(6755399441055744.);
+		return _mm_sub_pd(_mm_add_pd(a, magic), magic);
+	}
+};
+
+namespace sse2 {
+	#include "vecmathkernels.h"
+}
+
+
+
+static void expSSE2(const double* input, double* output, int size) {
+	sse2::expKernel<SSE2>(input, output, size);
+}
+
+
+
+static void logSSE2(const double* input, double* output, int size) {
+	sse2::logKernel<SSE2>(input, output, size);
+}
+#endif
+
+#ifdef VECMATH_AVX2
+// everything up to the end of this section may use AVX2 and FMA instructions
+#ifdef __clang__
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+// packet operations on four doubles
+struct AVX2 {
+	typedef __m256d Type;
+	enum { size = 4 };
+
+	static inline Type set1(double a) { return _mm256_set1_pd(a); }
+	static inline Type bits(long long a) { return _mm256_castsi256_pd(_mm256_set1_epi64x(a)); }
+	static inline Type load(const double* p) { return _mm256_loadu_pd(p); }
+	static inline void store(double* p, Type a) { _mm256_storeu_pd(p, a); }
+	static inline Type add(Type a, Type b) { return _mm256_add_pd(a, b); }
+	static inline Type sub(Type a, Type b) { return _mm256_sub_pd(a, b); }
+	static inline Type mul(Type a, Type b) { return _mm256_mul_pd(a, b); }
+	static inline Type div(Type a, Type b) { return _mm256_div_pd(a, b); }
+	static inline Type madd(Type a, Type b, Type c) { return _mm256_fmadd_pd(a, b, c); }
+	static inline Type min(Type a, Type b) { return _mm256_min_pd(a, b); }
+	static inline Type max(Type a, Type b) { return _mm256_max_pd(a, b); }
+	static inline Type bitAnd(Type a, Type b) { return _mm256_and_pd(a, b); }
+	static inline Type bitOr(Type a, Type b) { return _mm256_or_pd(a, b); }
+	static inline Type lt(Type a, Type b) { return _mm256_cmp_pd(a, b, _CMP_LT_OQ); }
+	static inline Type eq(Type a, Type b) { return _mm256_cmp_pd(a, b, _CMP_EQ_OQ); }
+	static inline Type nge(Type a, Type b) { return _mm256_cmp_pd(a, b, _CMP_NGE_UQ); }
+	static inline Type select(Type mask, Type a, Type b) {
+		return _mm256_blendv_pd(b, a, mask);
+	}
+	static inline Type shiftLeft52(Type a) {
+		return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_castpd_si256(a), 52));
+	}
+	static inline Type shiftRight52(Type a) {
+		return _mm256_castsi256_pd(_mm256_srli_epi64(_mm256_castpd_si256(a), 52));
+	}
+	static inline Type round(Type a) {
+		return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+	}
+};
+
+namespace avx2 {
+	#include "vecmathkernels.h"
+}
+
+
+
+static void expAVX2(const double* input, double* output, int size) {
+	avx2::expKernel<AVX2>(input, output, size);
+}
+
+
+
+static void logAVX2(const double* input, double* output, int size) {
+	avx2::logKernel<AVX2>(input, output, size);
+}
+
+#ifdef __clang__
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+#endif
+
+
+
+static void expScalar(const double* input, double* output, int size) {
+	for(int i = 0; i < size; ++i)
+		output[i] = std::exp(input[i]);
+}
+
+
+
+static void logScalar(const double* input, double* output, int size) {
+	for(int i = 0; i < size; ++i)
+		output[i] = std::log(input[i]);
+}
+
+
+
+struct Kernels {
+	Kernel exp;
+	Kernel log;
+	const char* instructionSet;
+};
+
+
+
+// picks the widest instruction set supported by the processor
+static Kernels selectKernels() {
+	Kernels kernels = { expScalar, logScalar, "none" };
+
+#ifdef __SSE2__
+	kernels.exp = expSSE2;
+	kernels.log = logSSE2;
+	kernels.instructionSet = "SSE2";
+#endif
+
+#ifdef VECMATH_AVX2
+	__builtin_cpu_init();
+
+	if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+		kernels.exp = expAVX2;
+		kernels.log = logAVX2;
+		kernels.instructionSet = "AVX2";
+	}
+#endif
+
+	return kernels;
+}
+
+static const Kernels& kernels() {
+	static const Kernels kernels = selectKernels();
+	return kernels;
+}
+
+
+
+void vexp(const double* input, double* output, int size) {
+	kernels().exp(input, output, size);
+}
+
+
+
+void vlog(const double* input, double* output, int size) {
+	kernels().log(input, output, size);
+}
+
+
+
+const char* vecmathInstructionSet() {
+	return kernels().instructionSet;
+}
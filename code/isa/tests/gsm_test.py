@@ -4,7 +4,7 @@ import unittest
 sys.path.append('./code')
 
 from isa import GSM
-from numpy import asarray, isnan, any, sqrt, sum, square, std, mean
+from numpy import asarray, isnan, any, all, sqrt, sum, square, std, mean, empty_like
 from numpy.random import randn, rand
 from scipy.stats import kstest, norm, laplace, cauchy
 from scipy.optimize import check_grad
@@ -46,6 +46,21 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_partial_fit(self):
+		gsm = GSM(1, 10)
+
+		data = laplace.rvs(size=[1, 100000])
+
+		for i in range(10):
+			gsm.partial_fit(data, max_iter=50, batch_size=1000)
+
+		p = kstest(gsm.sample(10000).flatten(), laplace.cdf)[1]
+
+		# stochastic EM should also reproduce Laplace samples
+		self.assertTrue(p > 0.0001)
+
+
+
 	def test_posterior(self):
 		gsm = GSM(1, 10)
 		gsm.train(laplace.rvs(size=[1, 10000]), max_iter=100, tol=-1)
@@ -91,6 +106,23 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_out(self):
+		gsm = GSM(2, 5)
+
+		samples = gsm.sample(100)
+		energy = gsm.energy(samples)
+
+		# results should be written into the given arrays
+		out = empty_like(energy)
+		self.assertTrue(gsm.energy(samples, out=out) is out)
+		self.assertTrue(all(out == energy))
+
+		out = empty_like(samples)
+		self.assertTrue(gsm.energy_gradient(samples, out=out) is out)
+		self.assertTrue(all(out == gsm.energy_gradient(samples)))
+
+
+
 	def test_normalize(self):
 		gsm = GSM(1, 5)
 		gsm.scales = rand(gsm.num_scales) + 1.
@@ -102,6 +134,19 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_seed(self):
+		gsm = GSM(2, 5)
+
+		gsm.seed(3)
+		samples1 = gsm.sample(100)
+		gsm.seed(3)
+		samples2 = gsm.sample(100)
+
+		# the same seed should produce the same samples
+		self.assertTrue(all(samples1 == samples2))
+
+
+
 	def test_pickle(self):
 		gsm0 = GSM(3, 11)
 
@@ -3,15 +3,18 @@ import unittest
 
 sys.path.append('./code')
 
-from isa import ISA
+from isa import ISA, memory_statistics
 from numpy import sqrt, sum, square, dot, var, eye, cov, diag, std, max, asarray, mean
-from numpy import ones, cos, sin, all, sort, log, pi, exp, copy
+from numpy import ones, cos, sin, all, sort, log, pi, exp, copy, save, empty_like
 from numpy.linalg import inv, eig
 from numpy.random import randn, permutation
 from scipy.optimize import check_grad
 from scipy.stats import kstest, laplace, ks_2samp
 from tempfile import mkstemp
-from pickle import dump, load
+from os import remove
+from pickle import dump, dumps, load
+from StringIO import StringIO
+from threading import Thread
 
 class Tests(unittest.TestCase):
 	def test_default_parameters(self):
@@ -45,6 +48,15 @@ class Tests(unittest.TestCase):
 
 		self.assertEqual(sys.getrefcount(B) - 1, 1)
 
+		# nullspace basis should follow changes of the basis
+		isa.A = randn(2, 5)
+		B = isa.nullspace_basis()
+
+		self.assertLess(max(abs(dot(isa.A, B.T).flatten())), 1e-10)
+
+		# projector should be consistent with nullspace basis
+		self.assertLess(max(abs((isa.nullspace_projector() - dot(B.T, B)).flatten())), 1e-10)
+
 
 
 	def test_initialize(self):
@@ -160,6 +172,30 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_energy_table(self):
+		isa = ISA(2)
+		isa.initialize()
+
+		isa.A = eye(2)
+
+		samples = isa.sample(10000)
+
+		isa.A = asarray([[cos(0.4), sin(0.4)], [-sin(0.4), cos(0.4)]])
+
+		params = isa.default_parameters()
+		params['training_method'] = 'LBFGS'
+		params['train_prior'] = False
+		params['max_iter'] = 1
+		params['lbfgs']['max_iter'] = 50
+		params['energy_table_tol'] = 1e-6
+
+		isa.train(samples, params)
+
+		# interpolated energies should not change the solution noticeably
+		self.assertLess(sqrt(sum(square(isa.A.flatten() - eye(2).flatten()))), 0.1)
+
+
+
 	def test_train_mp(self):
 		isa = ISA(5, 10)
 
@@ -294,6 +330,33 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_threads(self):
+		models = [ISA(2, 4), ISA(2, 4)]
+		counts = [0, 0]
+
+		def train(k):
+			def callback(i, isa):
+				counts[k] += 1
+
+			models[k].train(randn(2, 1000), parameters={
+				'verbosity': 0,
+				'max_iter': 5,
+				'callback': callback,
+				'sgd': {'max_iter': 1}})
+
+		# models can be trained concurrently, since training releases the interpreter lock
+		threads = [Thread(target=train, args=(k,)) for k in range(2)]
+
+		for thread in threads:
+			thread.start()
+		for thread in threads:
+			thread.join()
+
+		# callbacks should still be called while training runs without the lock
+		self.assertEqual(counts, [6, 6])
+
+
+
 	def test_sample_scales(self):
 		isa = ISA(2, 5, num_scales=4)
 
@@ -350,6 +413,48 @@ class Tests(unittest.TestCase):
 		# reconstruction should be perfect
 		self.assertLess(sum(square(dot(isa.A, states) - samples).flatten()), 1e-10)
 
+		params['sampling_method'] = 'nullspace'
+
+		states_null = isa.sample_posterior(isa.sample(1000), params).flatten()
+		states_null = states_null[permutation(states_null.size)]
+
+		# sampling in nullspace coordinates should not change the distribution
+		p = ks_2samp(states_null, states_prio)[1]
+
+		self.assertGreater(p, 0.0001)
+
+		states = isa.sample_posterior(samples, params)
+
+		self.assertLess(sum(square(dot(isa.A, states) - samples).flatten()), 1e-10)
+
+		params['sampling_method'] = 'gibbs'
+		params['gibbs']['cache_size'] = 20
+
+		states = isa.sample_posterior(samples, params)
+
+		# reusing factorizations should not affect reconstruction
+		self.assertLess(sum(square(dot(isa.A, states) - samples).flatten()), 1e-10)
+
+
+
+	def test_float32(self):
+		isa = ISA(2, 3)
+		isa.initialize()
+
+		samples = isa.sample(100).astype('float32')
+
+		# single precision arrays should be accepted by all methods
+		states = isa.sample_posterior(samples)
+
+		self.assertLess(max(abs(dot(isa.A, states) - samples).flatten()), 1e-4)
+
+		# single precision parameters should be stored in the precision of the module
+		A = isa.A.astype('float32')
+		isa.A = A
+
+		self.assertEqual(isa.A.dtype, isa.sample(1).dtype)
+		self.assertLess(max(abs(isa.A - A).flatten()), 1e-7)
+
 
 
 	def test_sample_posterior_ais(self):
@@ -449,6 +554,235 @@ class Tests(unittest.TestCase):
 
 
 
+	def test_seed(self):
+		isa = ISA(2, 3)
+		isa.initialize()
+
+		data = isa.sample(100)
+
+		isa.seed(1)
+		states1 = isa.sample_posterior(data)
+		isa.seed(1)
+		states2 = isa.sample_posterior(data)
+
+		# the same seed should produce the same samples
+		self.assertLess(max(abs(states1 - states2)), 1e-20)
+
+		isa.seed(2)
+		states3 = isa.sample_posterior(data)
+
+		self.assertGreater(max(abs(states1 - states3)), 0.)
+
+
+
+	def test_array_layouts(self):
+		isa = ISA(3, 4)
+		isa.initialize()
+
+		states = isa.sample_prior(100)
+		energy = isa.prior_energy(asarray(states, order='F'))
+
+		# row-major, strided and reversed arrays should be read without being rearranged first
+		self.assertLess(max(abs(isa.prior_energy(asarray(states, order='C')) - energy)), 1e-10)
+		self.assertLess(max(abs(isa.prior_energy(states.repeat(2, 1)[:, ::2]) - energy)), 1e-10)
+		self.assertLess(max(abs(isa.prior_energy(states[:, ::-1])[:, ::-1] - energy)), 1e-10)
+		self.assertLess(max(abs(isa.prior_energy(states[::-1].copy()[::-1]) - energy)), 1e-10)
+
+		# results handed over to NumPy should own usable memory
+		samples = isa.sample_prior(100)
+		samples += 1.
+		self.assertTrue(samples.flags['WRITEABLE'])
+
+
+
+	def test_out(self):
+		isa = ISA(2, 4)
+		isa.initialize()
+
+		data = isa.sample(100)
+		states = isa.sample_posterior(data)
+		energy = isa.prior_energy(states)
+
+		params = isa.default_parameters()
+		params['gibbs']['verbosity'] = 0
+
+		# results should be written into the given arrays
+		out = empty_like(energy)
+		self.assertTrue(isa.prior_energy(states, out=out) is out)
+		self.assertLess(max(abs(out - energy)), 1e-10)
+
+		out = empty_like(states)
+		self.assertTrue(isa.sample_posterior(data, params, out=out) is out)
+		self.assertLess(max(abs(dot(isa.A, out) - data)), 1e-6)
+
+		out = empty_like(states)
+		self.assertTrue(isa.matching_pursuit(data, out=out) is out)
+		self.assertLess(max(abs(out - isa.matching_pursuit(data))), 1e-10)
+
+		# arrays of the wrong shape should be rejected
+		self.assertRaises(RuntimeError, isa.prior_energy, states, out=empty_like(states))
+
+
+
+	def test_memory_statistics(self):
+		isa = ISA(2, 4)
+		isa.initialize()
+
+		data = isa.sample(100)
+
+		params = isa.default_parameters()
+		params['gibbs']['verbosity'] = 0
+		params['gibbs']['num_iter'] = 5
+
+		statistics = memory_statistics()
+
+		isa.sample_posterior(data, params)
+
+		# Gibbs sweeps should reuse memory of previous sweeps
+		self.assertGreater(memory_statistics()['reused'], statistics['reused'])
+		self.assertGreaterEqual(
+			memory_statistics()['allocations'] - statistics['allocations'],
+			memory_statistics()['reused'] - statistics['reused'])
+
+
+
+	def test_map_hidden_states(self):
+		isa = ISA(2, 4)
+		isa.initialize()
+
+		states = randn(4, 100)
+		isa.set_hidden_states(states)
+
+		tmp_file = mkstemp()[1]
+
+		# states should be moved into the file
+		isa.map_hidden_states(tmp_file)
+		self.assertLess(max(abs(isa.hidden_states() - states)), 1e-20)
+
+		params = isa.default_parameters()
+		params['max_iter'] = 2
+		params['train_prior'] = False
+		params['train_basis'] = False
+		params['gibbs']['block_size'] = 30
+
+		# chains should be sampled block by block
+		data = isa.sample(100)
+		isa.train(data, params)
+		self.assertLess(max(abs(dot(isa.A, isa.hidden_states()) - data)), 1e-8)
+
+		# states should be moved back into memory
+		isa.map_hidden_states()
+		self.assertLess(max(abs(dot(isa.A, isa.hidden_states()) - data)), 1e-8)
+
+		# states should be loaded from the file
+		isa1 = ISA(2, 4)
+		isa1.map_hidden_states(tmp_file)
+		self.assertLess(max(abs(isa.hidden_states() - isa1.hidden_states())), 1e-20)
+
+		# a file should not be mapped by two models at once
+		self.assertRaises(RuntimeError, isa.map_hidden_states, tmp_file)
+
+		# copies of the model should read the states into memory instead of sharing the file
+		isa2 = load(StringIO(dumps(isa1)))
+		self.assertLess(max(abs(isa1.hidden_states() - isa2.hidden_states())), 1e-20)
+
+		isa2.set_hidden_states(randn(4, 10))
+		self.assertEqual(isa1.hidden_states().shape, (4, 100))
+		self.assertLess(max(abs(isa.hidden_states() - isa1.hidden_states())), 1e-20)
+
+		isa1.map_hidden_states()
+		remove(tmp_file)
+
+
+
+	def test_loglikelihood_mapped_states(self):
+		isa = ISA(2, 4)
+		isa.initialize()
+
+		data = isa.sample(50)
+		isa.set_hidden_states(randn(4, 50))
+		states = isa.hidden_states()
+
+		params = isa.default_parameters()
+		params['ais']['num_samples'] = 4
+		params['ais']['num_iter'] = 10
+
+		isa.seed(1)
+		loglik = isa.loglikelihood(data, params, return_all=True)
+
+		tmp_file = mkstemp()[1]
+
+		# proposal distributions should not depend on the states of the Markov chain
+		isa.map_hidden_states(tmp_file)
+		isa.seed(1)
+		loglik_mapped = isa.loglikelihood(data, params, return_all=True)
+
+		self.assertLess(max(abs(loglik - loglik_mapped)), 1e-6)
+		self.assertLess(max(abs(isa.hidden_states() - states)), 1e-20)
+
+		isa.map_hidden_states()
+		remove(tmp_file)
+
+
+
+	def test_data_source(self):
+		isa = ISA(2, 4)
+		isa.initialize()
+
+		data = isa.sample(200)
+
+		tmp_file = mkstemp(suffix='.npy')[1]
+		save(tmp_file, data)
+
+		params = isa.default_parameters()
+		params['gibbs']['block_size'] = 64
+
+		# data should be read from the file block by block
+		states = isa.sample_posterior(tmp_file, params)
+		self.assertEqual(states.shape, (4, 200))
+		self.assertLess(max(abs(dot(isa.A, states) - data)), 1e-8)
+
+		# arrays in row-major order should be accepted without conversion
+		states = isa.sample_posterior(asarray(data, order='C'), params)
+		self.assertLess(max(abs(dot(isa.A, states) - data)), 1e-8)
+
+		params['max_iter'] = 2
+		params['sgd']['max_iter'] = 1
+
+		isa.initialize(tmp_file)
+		isa.train(tmp_file, params)
+		self.assertEqual(isa.hidden_states().shape, (4, 200))
+
+		remove(tmp_file)
+
+
+
+	def test_train_blocks(self):
+		isa = ISA(2)
+		isa.initialize()
+
+		data = isa.sample(1000)
+
+		tmp_file = mkstemp(suffix='.npy')[1]
+		save(tmp_file, data)
+
+		isa.A = asarray([[cos(0.4), sin(0.4)], [-sin(0.4), cos(0.4)]])
+		loss = isa.evaluate(data)
+
+		params = isa.default_parameters()
+		params['train_prior'] = False
+		params['max_iter'] = 1
+		params['sgd']['pocket'] = True
+		params['gibbs']['block_size'] = 100
+
+		# the basis should only be accepted if it improves the bound over all blocks
+		isa.train(tmp_file, params)
+		self.assertLess(isa.evaluate(data), loss + 1e-6)
+
+		remove(tmp_file)
+
+
+
 	def test_pickle(self):
 		isa0 = ISA(4, 16, ssize=3)
 		isa0.set_hidden_states(randn(16, 100))
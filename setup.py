@@ -64,7 +64,14 @@ modules = [
 			'code/isa/src/utils.cpp',
 			'code/isa/src/module.cpp',
 			'code/isa/src/callbacktrain.cpp',
-			'code/isa/src/distribution.cpp'],
+			'code/isa/src/distribution.cpp',
+			'code/isa/src/batchllt.cpp',
+			'code/isa/src/rng.cpp',
+			'code/isa/src/chainstore.cpp',
+			'code/isa/src/datasource.cpp',
+			'code/isa/src/gsmbank.cpp',
+			'code/isa/src/vecmath.cpp',
+			'code/isa/src/memorypool.cpp'],
 		include_dirs=[
 			'code',
 			'code/isa/include',
@@ -75,6 +82,7 @@ modules = [
 		extra_link_args=[
 			'code/liblbfgs/lib/.libs/liblbfgs.a'] + extra_link_args,
 		extra_compile_args=[
+			'-DEIGEN_USER_ALIGNED_MALLOC',
 			'-Wno-parentheses',
 			'-Wno-write-strings'] + extra_compile_args)]
 